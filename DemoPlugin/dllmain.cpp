@@ -10,6 +10,7 @@
 #include "dllmain.h"
 
 #include <iostream>
+#include <utility>
 #include <vector>
 
 //**************************************
@@ -17,10 +18,19 @@
 // hand to the app to use
 //**************************************
 
-// extra characters
-std::vector<char> chars()
+// extra characters, built in host memory
+Plugin::Span<char> chars(const Plugin::IManager& manager)
 {
-	return { '#', '-' };
+	Plugin::Span<char> r = manager.Allocate<char>(2);
+	r.data[0] = '#';
+	r.data[1] = '-';
+	return r;
+}
+
+// rare extra characters
+std::vector<std::pair<char, float>> weighted_chars()
+{
+	return { { '~', 0.25f } };
 }
 
 // seed manipulation function
@@ -33,6 +43,10 @@ int edit_seed(int seed)
 // an overriden draw method for the map
 void draw_custom_map(int w, int h, int seed);
 
+// the handles we register, so plugins that depend
+// on them are initialized after us
+PLUGIN_PROVIDES("mapSymbolsArena", "mapSymbolsWeighted", "seedGeneration")
+
 //**************************************
 // The minimum function requirements
 // that every plugin needs
@@ -41,17 +55,24 @@ void draw_custom_map(int w, int h, int seed);
 // define our register method
 DLL_MAIN(manager)
 {
-	//manager.Register("drawOverride", draw_custom_map);
-	manager.Register("mapSymbols", chars);
-	manager.Register("seedGeneration", edit_seed);
+	// stage everything and hand it over in one go
+	Plugin::Transaction t = manager.Begin();
+	//t.Register("drawOverride", draw_custom_map);
+	t.Register("mapSymbolsArena", chars);
+	t.Register("mapSymbolsWeighted", weighted_chars, Plugin::Purity::Constant);
+	t.Register("seedGeneration", edit_seed, Plugin::Purity::Pure);
+	t.Commit();
 }
 
 // define our unregister method
 DLL_EXIT(manager)
 {
-	//manager.Unregister("drawOverride", draw_custom_map);
-	manager.Unregister("mapSymbols", chars);
-	manager.Unregister("seedGeneration", edit_seed);
+	Plugin::Transaction t = manager.Begin();
+	//t.Unregister("drawOverride", draw_custom_map);
+	t.Unregister("mapSymbolsArena", chars);
+	t.Unregister("mapSymbolsWeighted", weighted_chars);
+	t.Unregister("seedGeneration", edit_seed);
+	t.Commit();
 }
 
 void draw_custom_map(int w, int h, int seed)
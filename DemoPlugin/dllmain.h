@@ -13,6 +13,11 @@
 // default implementation of GET_VERSION() returns VERSION
 GET_VERSION()
 
+// optionally list the handles your plugin registers with
+// PLUGIN_PROVIDES("handle", ...) and the handles it needs
+// from other plugins with PLUGIN_DEPENDS("handle", ...)
+// so the manager can initialize plugins in the right order
+
 // required to have the plugin entry point
 // for registering plugin functions
 // manager is the name of the IManager class
@@ -0,0 +1,105 @@
+//**************************************
+// alias_table.h
+//
+// Holds the definition for a weighted
+// symbol table that can be sampled in
+// constant time using Vose's alias
+// method, regardless of how many
+// symbols it holds or how skewed
+// their weights are
+//
+// Author: Nathan Ikola
+// nathan.ikola@gmail.com
+//**************************************
+#pragma once
+
+#include <assert.h>
+#include <utility>
+#include <vector>
+
+namespace Plugin
+{
+	template<typename Symbol>
+	class AliasTable final
+	{
+	public:
+		//******************************
+		// Default ctor is acceptable
+		//******************************
+		inline AliasTable() noexcept {}
+
+		//******************************
+		// Build the table from a list
+		// of (symbol, weight) pairs,
+		// weights need not sum to one
+		//******************************
+		inline AliasTable(const std::vector<std::pair<Symbol, float>>& weights) { Build(weights); }
+
+		//******************************
+		// Rebuild the table, this is
+		// linear in the symbol count
+		//******************************
+		void Build(const std::vector<std::pair<Symbol, float>>& weights)
+		{
+			const size_t n = weights.size();
+			m_symbols.resize(n);
+			m_probability.resize(n);
+			m_alias.resize(n);
+
+			double total = 0.0;
+			for (const auto& w : weights)
+			{
+				assert(w.second >= 0.0f);
+				total += w.second;
+			}
+			assert(n == 0 || total > 0.0);
+
+			// scale every weight so the average column is exactly one
+			std::vector<double> scaled(n);
+			std::vector<size_t> small, large;
+			for (size_t i{ 0 }; i < n; ++i)
+			{
+				m_symbols[i] = weights[i].first;
+				scaled[i] = weights[i].second * n / total;
+				(scaled[i] < 1.0 ? small : large).push_back(i);
+			}
+
+			// top up each short column with the excess of a tall one
+			while (!small.empty() && !large.empty())
+			{
+				size_t s = small.back(); small.pop_back();
+				size_t l = large.back(); large.pop_back();
+				m_probability[s] = scaled[s];
+				m_alias[s] = l;
+				scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+				(scaled[l] < 1.0 ? small : large).push_back(l);
+			}
+
+			// whatever is left over is full, up to rounding error
+			for (size_t i : large) { m_probability[i] = 1.0; m_alias[i] = i; }
+			for (size_t i : small) { m_probability[i] = 1.0; m_alias[i] = i; }
+		}
+
+		//******************************
+		// Pick a symbol given a column
+		// (any integer, it is reduced
+		// modulo the symbol count) and
+		// a coin flip in [0, 1)
+		//******************************
+		inline Symbol Sample(size_t column, double coin) const noexcept
+		{
+			assert(!m_symbols.empty());
+			column %= m_symbols.size();
+			return m_symbols[coin < m_probability[column] ? column : m_alias[column]];
+		}
+
+		//******************************
+		// Number of distinct columns
+		//******************************
+		inline size_t Size() const noexcept { return m_symbols.size(); }
+	private:
+		std::vector<Symbol> m_symbols = {};
+		std::vector<double> m_probability = {};
+		std::vector<size_t> m_alias = {};
+	};
+}
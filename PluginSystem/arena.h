@@ -0,0 +1,270 @@
+//**************************************
+// arena.h
+//
+// Holds the declaration for the host
+// owned allocators plugins can build
+// their results in, so that memory is
+// never allocated in one CRT and freed
+// in another
+//
+// An Arena hands out memory by bumping
+// a cursor and frees everything at
+// once on Reset. A Pool hands out
+// fixed size blocks that can be freed
+// one at a time or all at once
+//
+// Neither is thread safe on its own,
+// the plugin manager guards them or
+// keeps one per thread
+//
+// Author: Nathan Ikola
+// nathan.ikola@gmail.com
+//**************************************
+#pragma once
+
+#include <assert.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "imanager.h"
+
+namespace Plugin
+{
+	// the size of each block an arena asks the system for
+	const size_t DEFAULT_ARENA_BLOCK = 64 * 1024;
+	// the number of objects each pool chunk holds
+	const size_t DEFAULT_POOL_CHUNK = 64;
+
+	//**********************************
+	// Allocation counters, system
+	// allocations are the ones that
+	// actually reach malloc
+	//**********************************
+	struct AllocatorStats
+	{
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+		uint64_t systemAllocations = 0;
+		uint64_t resets = 0;
+	};
+
+	class Arena final
+	{
+	public:
+		//******************************
+		// Ctor sets the block size, no
+		// memory is taken until used
+		//******************************
+		inline Arena(size_t blockSize = DEFAULT_ARENA_BLOCK) noexcept : m_blockSize(blockSize) {}
+
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+		Arena(Arena&&) = default;
+		Arena& operator=(Arena&&) = default;
+
+		//******************************
+		// Allocate size bytes aligned
+		// to align, a power of two
+		//******************************
+		inline void* Allocate(size_t size, size_t align = alignof(std::max_align_t))
+		{
+			assert(align != 0 && (align & (align - 1)) == 0);
+			++m_stats.allocations;
+			m_stats.bytes += size;
+
+			if (m_block < m_blocks.size())
+			{
+				Block& b = m_blocks[m_block];
+				size_t offset = AlignUp(b.memory.get(), m_offset, align);
+				if (offset + size <= b.size)
+				{
+					m_offset = offset + size;
+					return b.memory.get() + offset;
+				}
+			}
+
+			// move on to the next block that fits, keeping the
+			// ones we skip so they are reused after a Reset
+			size_t next = m_blocks.empty() ? 0 : m_block + 1;
+			while (next < m_blocks.size() && m_blocks[next].size < size + align)
+				++next;
+			if (next == m_blocks.size())
+			{
+				size_t bytes = size + align > m_blockSize ? size + align : m_blockSize;
+				m_blocks.push_back({ std::unique_ptr<char[]>(new char[bytes]), bytes });
+				++m_stats.systemAllocations;
+			}
+
+			m_block = next;
+			Block& b = m_blocks[m_block];
+			size_t offset = AlignUp(b.memory.get(), 0, align);
+			m_offset = offset + size;
+			return b.memory.get() + offset;
+		}
+
+		//******************************
+		// Free everything at once, the
+		// blocks are kept for reuse
+		//******************************
+		inline void Reset() noexcept
+		{
+			m_block = 0;
+			m_offset = 0;
+			++m_stats.resets;
+		}
+
+		//******************************
+		// Give the blocks back as well
+		//******************************
+		inline void Release() noexcept
+		{
+			m_blocks.clear();
+			m_block = 0;
+			m_offset = 0;
+		}
+
+		//******************************
+		// Counters since construction
+		//******************************
+		inline const AllocatorStats& Stats() const noexcept { return m_stats; }
+	private:
+		struct Block
+		{
+			std::unique_ptr<char[]> memory;
+			size_t size;
+		};
+
+		//******************************
+		// Round offset up so that the
+		// address is aligned
+		//******************************
+		static inline size_t AlignUp(const char* base, size_t offset, size_t align) noexcept
+		{
+			uintptr_t address = reinterpret_cast<uintptr_t>(base) + offset;
+			return offset + ((align - (address & (align - 1))) & (align - 1));
+		}
+
+		size_t m_blockSize;
+		std::vector<Block> m_blocks = {};
+		// the block and offset of the cursor
+		size_t m_block = 0;
+		size_t m_offset = 0;
+		AllocatorStats m_stats;
+	};
+
+	class Pool final
+	{
+	public:
+		//******************************
+		// Ctor sets the object size,
+		// rounded up so every object
+		// is suitably aligned
+		//******************************
+		inline Pool(size_t objectSize, size_t chunkCount = DEFAULT_POOL_CHUNK) noexcept
+			: m_chunkCount(chunkCount)
+		{
+			const size_t align = alignof(std::max_align_t);
+			m_objectSize = objectSize < sizeof(void*) ? sizeof(void*) : objectSize;
+			m_objectSize = (m_objectSize + align - 1) & ~(align - 1);
+		}
+
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		//******************************
+		// Take an object off the free
+		// list, carving a new chunk if
+		// the list is empty
+		//******************************
+		inline void* Allocate()
+		{
+			if (m_free == nullptr)
+				Carve(AddChunk());
+			++m_stats.allocations;
+			m_stats.bytes += m_objectSize;
+			void* r = m_free;
+			m_free = *static_cast<void**>(m_free);
+			return r;
+		}
+
+		//******************************
+		// Put an object back
+		//******************************
+		inline void Free(void* object) noexcept
+		{
+			assert(object != nullptr);
+			*static_cast<void**>(object) = m_free;
+			m_free = object;
+		}
+
+		//******************************
+		// Free every object at once,
+		// the chunks are kept for reuse
+		//******************************
+		inline void Reset() noexcept
+		{
+			m_free = nullptr;
+			for (auto& chunk : m_chunks)
+				Carve(chunk.get());
+			++m_stats.resets;
+		}
+
+		//******************************
+		// The rounded object size
+		//******************************
+		inline size_t ObjectSize() const noexcept { return m_objectSize; }
+
+		//******************************
+		// Counters since construction
+		//******************************
+		inline const AllocatorStats& Stats() const noexcept { return m_stats; }
+	private:
+		//******************************
+		// Allocate another chunk
+		//******************************
+		inline char* AddChunk()
+		{
+			m_chunks.emplace_back(new char[m_objectSize * m_chunkCount]);
+			++m_stats.systemAllocations;
+			return m_chunks.back().get();
+		}
+
+		//******************************
+		// Thread a chunk's objects onto
+		// the free list
+		//******************************
+		inline void Carve(char* chunk) noexcept
+		{
+			for (size_t i{ m_chunkCount }; i-- > 0;)
+			{
+				void* object = chunk + i * m_objectSize;
+				*static_cast<void**>(object) = m_free;
+				m_free = object;
+			}
+		}
+
+		size_t m_objectSize;
+		size_t m_chunkCount;
+		std::vector<std::unique_ptr<char[]>> m_chunks = {};
+		void* m_free = nullptr;
+		AllocatorStats m_stats;
+	};
+
+	//**********************************
+	// The calling thread's call or
+	// frame arena. Each thread frees
+	// its own when it is done with a
+	// call or a frame, so a reset on
+	// one thread never frees what
+	// another is reading
+	//**********************************
+	inline Arena& ThreadArena(AllocScope scope) noexcept
+	{
+		assert(scope != AllocScope::Plugin);
+		static thread_local Arena call;
+		static thread_local Arena frame;
+		return scope == AllocScope::Call ? call : frame;
+	}
+}
@@ -0,0 +1,318 @@
+//**************************************
+// benchmarks.h
+//
+// Small timing harnesses for the plugin
+// manager, run from main when built
+// with PLUGIN_BENCHMARKS defined
+//
+// Author: Nathan Ikola
+// nathan.ikola@gmail.com
+//**************************************
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "plugin_manager.h"
+#include "renderer.h"
+#include "world.h"
+
+namespace Plugin
+{
+	namespace Benchmarks
+	{
+		using Clock = std::chrono::steady_clock;
+
+		//**********************************
+		// Seconds elapsed since start
+		//**********************************
+		inline double Seconds(Clock::time_point start) noexcept
+		{
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		//**********************************
+		// Heap allocations made through
+		// CountingAllocator so far
+		//**********************************
+		inline uint64_t& HeapAllocations() noexcept
+		{
+			static uint64_t count = 0;
+			return count;
+		}
+
+		//**********************************
+		// std::allocator that counts the
+		// allocations it makes
+		//**********************************
+		template<typename T>
+		struct CountingAllocator : std::allocator<T>
+		{
+			template<typename U> struct rebind { using other = CountingAllocator<U>; };
+
+			CountingAllocator() noexcept = default;
+			template<typename U> CountingAllocator(const CountingAllocator<U>&) noexcept {}
+
+			inline T* allocate(size_t n)
+			{
+				++HeapAllocations();
+				return std::allocator<T>::allocate(n);
+			}
+		};
+
+		//**********************************
+		// Symbol handler that returns a
+		// vector, one heap allocation in
+		// the callee and one free in the
+		// caller on every call
+		//**********************************
+		inline std::vector<char, CountingAllocator<char>> VectorSymbols(size_t count)
+		{
+			std::vector<char, CountingAllocator<char>> r(count);
+			for (size_t i{ 0 }; i < count; ++i) r[i] = static_cast<char>('!' + i % 64);
+			return r;
+		}
+
+		//**********************************
+		// The same handler building its
+		// result in the host's call arena
+		//**********************************
+		inline Span<char> ArenaSymbols(const IManager& manager, size_t count)
+		{
+			Span<char> r = manager.Allocate<char>(count);
+			for (size_t i{ 0 }; i < count; ++i) r.data[i] = static_cast<char>('!' + i % 64);
+			return r;
+		}
+
+		//**********************************
+		// Compare returning symbols in
+		// vectors against returning them
+		// in the call arena
+		//**********************************
+		inline void SymbolAllocations(std::ostream& out, size_t calls = 100000, size_t symbols = 64)
+		{
+			PluginManager& pm = PluginManager::GetInstance();
+			IManager host = pm;
+			size_t checksum = 0;
+
+			uint64_t heapBefore = HeapAllocations();
+			Clock::time_point start = Clock::now();
+			for (size_t i{ 0 }; i < calls; ++i)
+				for (char c : VectorSymbols(symbols)) checksum += c;
+			double vectorTime = Seconds(start);
+			uint64_t heapAllocations = HeapAllocations() - heapBefore;
+
+			AllocatorStats before = pm.GetArenaStats(AllocScope::Call);
+			start = Clock::now();
+			for (size_t i{ 0 }; i < calls; ++i)
+			{
+				for (char c : ArenaSymbols(host, symbols)) checksum += c;
+				pm.ResetArena(AllocScope::Call);
+			}
+			double arenaTime = Seconds(start);
+			AllocatorStats after = pm.GetArenaStats(AllocScope::Call);
+
+			double total = static_cast<double>(calls * symbols);
+			out << "symbol allocations (" << calls << " calls x " << symbols << " symbols)\n";
+			out << "  vector: " << heapAllocations << " heap allocations, "
+				<< total / vectorTime / 1e6 << " Msymbols/s\n";
+			out << "  arena:  " << (after.systemAllocations - before.systemAllocations) << " heap allocations, "
+				<< (after.allocations - before.allocations) << " arena allocations, "
+				<< total / arenaTime / 1e6 << " Msymbols/s\n";
+			out << "  (checksum " << checksum << ")\n";
+		}
+
+		//**********************************
+		// Animate a map where a few cells
+		// change every tick and compare
+		// the dirty-region renderer with
+		// reprinting the whole frame
+		//**********************************
+		inline void RenderFrames(std::ostream& out, int w = 120, int h = 40, int frames = 200, int changesPerFrame = 24)
+		{
+			std::ostringstream terminal;
+			Renderer renderer(terminal);
+			renderer.Resize(w, h);
+			for (int y{ 0 }; y < h; ++y)
+				for (int x{ 0 }; x < w; ++x)
+					renderer.Row(y)[x] = ".^ "[(x * 7 + y * 13) % 3];
+
+			out << "render (" << w << "x" << h << ", " << changesPerFrame << " changes per frame)\n";
+			out << "  full redraw: " << (w + 1) * h << " bytes per frame\n";
+
+			size_t bytes = 0;
+			double ms = 0.0;
+			unsigned int state = 12345;
+			for (int f{ 0 }; f < frames; ++f)
+			{
+				for (int c{ 0 }; c < changesPerFrame; ++c)
+				{
+					state = state * 1103515245u + 12345u;
+					renderer.Row((state >> 8) % h)[(state >> 16) % w] = "#-~"[f % 3];
+				}
+				renderer.Present();
+				// the first frame is always a full paint
+				if (f == 0)
+				{
+					out << "  first frame: " << renderer.Stats().bytes << " bytes\n";
+					continue;
+				}
+				bytes += renderer.Stats().bytes;
+				ms += renderer.Stats().ms;
+			}
+
+			out << "  dirty runs:  " << bytes / (frames - 1) << " bytes per frame, "
+				<< ms / (frames - 1) << " ms per frame\n";
+		}
+
+		//**********************************
+		// Animate the map itself through
+		// Map::Draw, holding each seed for
+		// a few ticks while a plugin marks
+		// a small region dirty every tick,
+		// and report what each kind of
+		// frame cost
+		//**********************************
+		inline void MapFrames(std::ostream& out, int w = 120, int h = 40, int frames = 200, int hold = 10)
+		{
+			PluginManager& pm = PluginManager::GetInstance();
+			IManager host = pm;
+			std::ostringstream terminal;
+			Renderer renderer(terminal);
+			renderer.Resize(w, h);
+			Renderer* previous = pm.SetRenderer(&renderer);
+			Map map;
+
+			size_t heldBytes = 0, heldFrames = 0, cleanRows = 0, reseedBytes = 0, reseedFrames = 0;
+			double ms = 0.0;
+			for (int f{ 0 }; f < frames; ++f)
+			{
+				// stands in for a plugin animating a sprite between ticks
+				host.MarkDirty((f * 3) % w, f % h, 4, 1);
+				map.Draw(renderer, f / hold + 1);
+				ms += renderer.Stats().ms;
+				// the first frame is always a full paint
+				if (f == 0)
+					continue;
+				if (f % hold == 0)
+				{
+					reseedBytes += renderer.Stats().bytes;
+					++reseedFrames;
+				}
+				else
+				{
+					heldBytes += renderer.Stats().bytes;
+					cleanRows += renderer.Stats().cleanRows;
+					++heldFrames;
+				}
+			}
+			pm.SetRenderer(previous);
+
+			out << "map frames (" << w << "x" << h << ", new seed every " << hold << " frames)\n";
+			out << "  full redraw: " << (w + 1) * h << " bytes per frame\n";
+			if (heldFrames != 0)
+				out << "  same seed:   " << heldBytes / heldFrames << " bytes per frame, "
+					<< cleanRows / heldFrames << " of " << h << " rows clean\n";
+			if (reseedFrames != 0)
+				out << "  new seed:    " << reseedBytes / reseedFrames << " bytes per frame\n";
+			out << "  " << ms / frames << " ms per frame presenting\n";
+			if (pm.ExecutePlugins("seedGeneration", 1) == pm.ExecutePlugins("seedGeneration", 2))
+				out << "  (the loaded seedGeneration plugins give every seed the same map)\n";
+		}
+
+		//**********************************
+		// Scroll a viewport across the
+		// world and report how well the
+		// tile cache kept up
+		//**********************************
+		inline void ScrollWorld(std::ostream& out, int w = 80, int h = 24, int frames = 300, int step = 2)
+		{
+			std::ostringstream terminal;
+			Renderer renderer(terminal);
+			renderer.Resize(w, h);
+			Map map;
+			World world(map, DEFAULT_TILE_SIZE, 256 * 1024);
+
+			Clock::time_point start = Clock::now();
+			for (int f{ 0 }; f < frames; ++f)
+				world.Draw(renderer, f * step, f * step / 4, 1);
+			double ms = Seconds(start) * 1000.0;
+
+			TileCacheStats s = world.Stats();
+			out << "world scroll (" << w << "x" << h << ", " << frames << " frames)\n";
+			out << "  " << ms / frames << " ms per frame, hit rate " << s.HitRate() * 100.0 << "%\n";
+			out << "  " << s.hits << " hits, " << s.misses << " misses, " << s.prefetched << " prefetched, "
+				<< s.evictions << " evictions\n";
+			out << "  " << s.tiles << " tiles, " << s.bytes << " of " << s.budget << " bytes\n";
+		}
+
+		//**********************************
+		// Register and unregister a plugin
+		// with hundreds of handles one call
+		// at a time and as a Transaction
+		//**********************************
+		inline void RegistrationBatches(std::ostream& out, size_t handles = 500, int rounds = 20)
+		{
+			PluginManager& pm = PluginManager::GetInstance();
+			IManager host = pm;
+
+			std::vector<std::string> names(handles);
+			std::vector<void*> funcs(handles);
+			for (size_t i{ 0 }; i < handles; ++i)
+			{
+				names[i] = "benchmarkHandle" + std::to_string(i);
+				// stand-ins, these are never called
+				funcs[i] = reinterpret_cast<void*>((i + 1) * 16);
+			}
+
+			double singleLoad = 0.0, singleUnload = 0.0, batchLoad = 0.0, batchUnload = 0.0;
+			for (int r{ 0 }; r < rounds; ++r)
+			{
+				Clock::time_point start = Clock::now();
+				for (size_t i{ 0 }; i < handles; ++i)
+					host.Register(names[i].c_str(), funcs[i]);
+				singleLoad += Seconds(start);
+				start = Clock::now();
+				for (size_t i{ 0 }; i < handles; ++i)
+					host.Unregister(names[i].c_str(), funcs[i]);
+				singleUnload += Seconds(start);
+
+				start = Clock::now();
+				Transaction load = host.Begin();
+				for (size_t i{ 0 }; i < handles; ++i)
+					load.Register(names[i].c_str(), funcs[i]);
+				load.Commit();
+				batchLoad += Seconds(start);
+				start = Clock::now();
+				Transaction unload = host.Begin();
+				for (size_t i{ 0 }; i < handles; ++i)
+					unload.Unregister(names[i].c_str(), funcs[i]);
+				unload.Commit();
+				batchUnload += Seconds(start);
+			}
+
+			out << "registration (" << handles << " handles, " << rounds << " rounds)\n";
+			out << "  single calls: load " << singleLoad * 1000.0 / rounds << " ms, unload "
+				<< singleUnload * 1000.0 / rounds << " ms\n";
+			out << "  transaction:  load " << batchLoad * 1000.0 / rounds << " ms, unload "
+				<< batchUnload * 1000.0 / rounds << " ms\n";
+		}
+
+		//**********************************
+		// Run every benchmark
+		//**********************************
+		inline void RunAll(std::ostream& out)
+		{
+			SymbolAllocations(out);
+			RenderFrames(out);
+			MapFrames(out);
+			ScrollWorld(out);
+			RegistrationBatches(out);
+		}
+	}
+}
@@ -0,0 +1,544 @@
+//**************************************
+// event_bus.h
+//
+// Holds the declaration for the plugin
+// event bus, which lets plugins talk
+// to each other asynchronously by
+// publishing events to named topics
+//
+// Each topic owns a bounded lock-free
+// queue that any number of producers
+// may push into, and a single consumer
+// thread, started by the first
+// subscriber, that delivers the events
+// to the topic's subscribers. Producers
+// never wait on subscribers; when a
+// queue is full the event is dropped
+// and counted instead
+//
+// Author: Nathan Ikola
+// nathan.ikola@gmail.com
+//**************************************
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "imanager.h"
+
+namespace Plugin
+{
+	// the number of events each topic can hold before dropping
+	const size_t DEFAULT_TOPIC_CAPACITY = 1024;
+	// the most events a consumer thread pulls off before delivering
+	const size_t EVENT_DELIVERY_BATCH = 64;
+
+	//**********************************
+	// Bounded multi-producer single-
+	// consumer queue of fixed size
+	// events. Each cell carries a
+	// sequence number so producers can
+	// claim cells with a single CAS
+	//**********************************
+	class EventQueue final
+	{
+	public:
+		//******************************
+		// A single event copied out of
+		// the queue by the consumer
+		//******************************
+		struct Event
+		{
+			size_t size = 0;
+			unsigned char data[MAX_EVENT_SIZE];
+		};
+
+		//******************************
+		// Ctor rounds the capacity up
+		// to a power of two so cells
+		// can be indexed with a mask
+		//******************************
+		inline EventQueue(size_t capacity)
+		{
+			size_t size = 2;
+			while (size < capacity) size <<= 1;
+			m_mask = size - 1;
+			m_cells.reset(new Cell[size]);
+			for (size_t i{ 0 }; i < size; ++i)
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		//******************************
+		// Explicitly delete copy and
+		// move operations, the cells
+		// hold atomics
+		//******************************
+		EventQueue(const EventQueue&) = delete;
+		EventQueue& operator=(const EventQueue&) = delete;
+
+		//******************************
+		// Push a single event, returns
+		// false if the queue is full.
+		// Safe to call from any thread
+		//******************************
+		inline bool Push(const void* data, size_t size) noexcept
+		{
+			assert(size <= MAX_EVENT_SIZE);
+			Cell* cell = nullptr;
+			size_t pos = m_enqueue.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				cell = &m_cells[pos & m_mask];
+				size_t seq = cell->sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+				if (diff == 0)
+				{
+					// the cell is free, try to claim it
+					if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				// the consumer has not freed this cell yet
+				else if (diff < 0)
+					return false;
+				// another producer beat us to it
+				else
+					pos = m_enqueue.load(std::memory_order_relaxed);
+			}
+			std::memcpy(cell->data, data, size);
+			cell->size = size;
+			cell->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		//******************************
+		// Pop a single event, returns
+		// false if the queue is empty.
+		// Only the consumer may call it
+		//******************************
+		inline bool Pop(Event& out) noexcept
+		{
+			size_t pos = m_dequeue.load(std::memory_order_relaxed);
+			Cell& cell = m_cells[pos & m_mask];
+			if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+				return false;
+			out.size = cell.size;
+			std::memcpy(out.data, cell.data, cell.size);
+			// hand the cell back to the producers one lap later
+			cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+			m_dequeue.store(pos + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		//******************************
+		// True if the next Pop would
+		// succeed. Only the consumer
+		// may call it
+		//******************************
+		inline bool Ready() const noexcept
+		{
+			size_t pos = m_dequeue.load(std::memory_order_relaxed);
+			return m_cells[pos & m_mask].sequence.load(std::memory_order_acquire) == pos + 1;
+		}
+
+		//******************************
+		// Approximate number of events
+		// waiting in the queue
+		//******************************
+		inline size_t Depth() const noexcept
+		{
+			size_t head = m_dequeue.load(std::memory_order_relaxed);
+			size_t tail = m_enqueue.load(std::memory_order_relaxed);
+			return tail > head ? tail - head : 0;
+		}
+
+		//******************************
+		// The number of cells
+		//******************************
+		inline size_t Capacity() const noexcept { return m_mask + 1; }
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			size_t size;
+			unsigned char data[MAX_EVENT_SIZE];
+		};
+
+		std::unique_ptr<Cell[]> m_cells;
+		size_t m_mask = 0;
+
+		// keep the producer and consumer cursors on
+		// separate cache lines so they do not fight
+		char m_pad0[64] = {};
+		std::atomic<size_t> m_enqueue = { 0 };
+		char m_pad1[64] = {};
+		std::atomic<size_t> m_dequeue = { 0 };
+	};
+
+	//**********************************
+	// A named topic: its queue, its
+	// subscribers and the thread that
+	// delivers events to them
+	//**********************************
+	class EventTopic final
+	{
+	public:
+		// the signature every subscriber must have
+		using Subscriber = void(*)(const void* event, size_t size);
+
+		//******************************
+		// Ctor sizes the queue, the
+		// consumer is only started once
+		// somebody subscribes
+		//******************************
+		inline EventTopic(size_t capacity = DEFAULT_TOPIC_CAPACITY)
+			: m_queue(capacity), m_batch(EVENT_DELIVERY_BATCH) {}
+
+		//******************************
+		// Dtor delivers anything still
+		// queued, then joins
+		//******************************
+		inline ~EventTopic() noexcept
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_wakeLock);
+				m_stop.store(true, std::memory_order_release);
+			}
+			m_wake.notify_one();
+			if (m_consumer.joinable())
+				m_consumer.join();
+		}
+
+		EventTopic(const EventTopic&) = delete;
+		EventTopic& operator=(const EventTopic&) = delete;
+
+		//******************************
+		// Push count events of size
+		// bytes each, returns how many
+		// were accepted. Never waits
+		//******************************
+		inline size_t Publish(const void* events, size_t size, size_t count) noexcept
+		{
+			// with no consumer nothing would ever drain the queue
+			if (!m_started.load(std::memory_order_acquire))
+			{
+				m_dropped.fetch_add(count, std::memory_order_relaxed);
+				return 0;
+			}
+
+			const unsigned char* cursor = static_cast<const unsigned char*>(events);
+			size_t accepted = 0;
+			for (; accepted < count; ++accepted, cursor += size)
+				if (!m_queue.Push(cursor, size))
+					break;
+
+			m_published.fetch_add(accepted, std::memory_order_relaxed);
+			if (accepted != count)
+				m_dropped.fetch_add(count - accepted, std::memory_order_relaxed);
+			if (accepted != 0)
+				Wake();
+			return accepted;
+		}
+
+		//******************************
+		// Add a subscriber, starting
+		// the consumer for the first
+		//******************************
+		inline void Subscribe(void* func) noexcept
+		{
+			assert(func != nullptr);
+			std::lock_guard<std::mutex> lock(m_subscriberLock);
+			for (void* f : m_subscribers) assert(f != func);
+			m_subscribers.push_back(func);
+			m_version.fetch_add(1);
+			if (!m_started.load(std::memory_order_relaxed))
+			{
+				m_consumer = std::thread(&EventTopic::Consume, this);
+				m_started.store(true, std::memory_order_release);
+			}
+		}
+
+		//******************************
+		// Remove a subscriber. Once
+		// this returns the consumer
+		// will not call func again,
+		// so a plugin may unload. Safe
+		// to call from a subscriber
+		//******************************
+		inline void Unsubscribe(void* func) noexcept
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_subscriberLock);
+				auto iter{ m_subscribers.begin() };
+				while (iter != m_subscribers.end() && (*iter) != func) ++iter;
+				// should not unsubscribe something that never subscribed
+				assert(iter != m_subscribers.end());
+				if (iter == m_subscribers.end())
+					return;
+				m_subscribers.erase(iter);
+				m_version.fetch_add(1);
+			}
+
+			// the consumer picks up the new list before its next
+			// event, so from inside a subscriber there is nothing
+			// to wait for
+			if (std::this_thread::get_id() == m_consumer.get_id())
+				return;
+
+			// otherwise wait out the event in flight, which may
+			// still be using the old list
+			uint64_t epoch = m_epoch.load();
+			if ((epoch & 1) == 0)
+				return;
+			std::unique_lock<std::mutex> lock(m_epochLock);
+			m_epochWaiters.fetch_add(1);
+			m_epochDone.wait(lock, [this, epoch] { return m_epoch.load() != epoch; });
+			m_epochWaiters.fetch_sub(1);
+		}
+
+		//******************************
+		// Snapshot of the counters
+		//******************************
+		inline TopicStats Stats() const noexcept
+		{
+			TopicStats s;
+			s.depth = m_queue.Depth();
+			s.capacity = m_queue.Capacity();
+			s.published = m_published.load(std::memory_order_relaxed);
+			s.delivered = m_delivered.load(std::memory_order_relaxed);
+			s.dropped = m_dropped.load(std::memory_order_relaxed);
+			return s;
+		}
+	private:
+		//******************************
+		// Consumer thread body
+		//******************************
+		inline void Consume() noexcept
+		{
+			for (;;)
+			{
+				// grab a batch off the queue
+				size_t count = 0;
+				while (count < m_batch.size() && m_queue.Pop(m_batch[count]))
+					++count;
+
+				if (count != 0)
+				{
+					Deliver(count);
+					// whatever subscribers allocated for the call or
+					// the frame is done with once they have returned
+					ThreadArena(AllocScope::Call).Reset();
+					ThreadArena(AllocScope::Frame).Reset();
+					continue;
+				}
+
+				// only stop once the queue has been drained
+				if (m_stop.load(std::memory_order_acquire))
+					return;
+
+				// announce that we are going to sleep before the last
+				// look at the queue; a producer either sees the flag and
+				// wakes us, or we see its event
+				std::unique_lock<std::mutex> lock(m_wakeLock);
+				m_sleeping.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				m_wake.wait(lock, [this]
+				{
+					return m_stop.load(std::memory_order_acquire) || m_queue.Ready();
+				});
+				m_sleeping.store(false, std::memory_order_relaxed);
+			}
+		}
+
+		//******************************
+		// Wake the consumer if it is
+		// asleep, called by producers
+		// after pushing
+		//******************************
+		inline void Wake() noexcept
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!m_sleeping.load(std::memory_order_relaxed))
+				return;
+			// taking the lock means the consumer is either waiting
+			// already or has not yet checked the queue
+			std::lock_guard<std::mutex> lock(m_wakeLock);
+			m_wake.notify_one();
+		}
+
+		//******************************
+		// Hand a batch of events to
+		// every subscriber. No lock is
+		// held while subscribers run,
+		// so they may subscribe or
+		// unsubscribe themselves
+		//******************************
+		inline void Deliver(size_t count) noexcept
+		{
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				// odd while an event is being delivered
+				m_epoch.fetch_add(1);
+
+				// pick up any change to the list since the last event
+				uint64_t version = m_version.load();
+				if (version != m_deliveryVersion)
+				{
+					std::lock_guard<std::mutex> lock(m_subscriberLock);
+					m_delivery = m_subscribers;
+					m_deliveryVersion = m_version.load();
+				}
+
+				for (void* f : m_delivery)
+					reinterpret_cast<Subscriber>(f)(m_batch[i].data, m_batch[i].size);
+
+				m_epoch.fetch_add(1);
+				if (m_epochWaiters.load() != 0)
+				{
+					std::lock_guard<std::mutex> lock(m_epochLock);
+					m_epochDone.notify_all();
+				}
+			}
+			m_delivered.fetch_add(count, std::memory_order_relaxed);
+		}
+
+		EventQueue m_queue;
+
+		// only touched by the consumer thread
+		std::vector<EventQueue::Event> m_batch;
+		std::vector<void*> m_delivery = {};
+		uint64_t m_deliveryVersion = 0;
+
+		// the subscriber list, bumping the version
+		// makes the consumer copy it again
+		std::mutex m_subscriberLock;
+		std::vector<void*> m_subscribers = {};
+		std::atomic<uint64_t> m_version = { 0 };
+
+		// lets Unsubscribe wait out an event in flight
+		std::atomic<uint64_t> m_epoch = { 0 };
+		std::atomic<uint32_t> m_epochWaiters = { 0 };
+		std::mutex m_epochLock;
+		std::condition_variable m_epochDone;
+
+		std::mutex m_wakeLock;
+		std::condition_variable m_wake;
+		std::atomic<bool> m_sleeping = { false };
+		std::atomic<bool> m_stop = { false };
+		// set once m_consumer is running, it is never reassigned
+		std::atomic<bool> m_started = { false };
+		std::thread m_consumer;
+
+		std::atomic<uint64_t> m_published = { 0 };
+		std::atomic<uint64_t> m_delivered = { 0 };
+		std::atomic<uint64_t> m_dropped = { 0 };
+	};
+
+	//**********************************
+	// Collection of topics, created
+	// when they are subscribed to or
+	// opened, never by publishing
+	//**********************************
+	class EventBus final
+	{
+	public:
+		//******************************
+		// Publish a batch of events,
+		// dropped if nobody ever
+		// subscribed to the topic
+		//******************************
+		inline size_t Publish(const char* topic, const void* events, size_t size, size_t count) noexcept
+		{
+			assert(events != nullptr || count == 0);
+			EventTopic* t = Find(topic);
+			return t != nullptr ? t->Publish(events, size, count) : 0;
+		}
+
+		//******************************
+		// Publish a batch of events to
+		// a topic from Open, without
+		// looking it up or locking
+		//******************************
+		inline size_t Publish(EventTopic* topic, const void* events, size_t size, size_t count) noexcept
+		{
+			assert(topic != nullptr);
+			assert(events != nullptr || count == 0);
+			return topic->Publish(events, size, count);
+		}
+
+		//******************************
+		// Subscribe to a topic
+		//******************************
+		inline void Subscribe(const char* topic, void* func) noexcept
+		{
+			Open(topic)->Subscribe(func);
+		}
+
+		//******************************
+		// Unsubscribe from a topic
+		//******************************
+		inline void Unsubscribe(const char* topic, void* func) noexcept
+		{
+			EventTopic* t = Find(topic);
+			// should not unsubscribe from a topic never subscribed to
+			assert(t != nullptr);
+			if (t != nullptr)
+				t->Unsubscribe(func);
+		}
+
+		//******************************
+		// Counters for a single topic,
+		// all zero if it was never used
+		//******************************
+		inline TopicStats Stats(const char* topic) noexcept
+		{
+			EventTopic* t = Find(topic);
+			return t != nullptr ? t->Stats() : TopicStats();
+		}
+
+		//******************************
+		// Topic getter, creating it if
+		// needed. Topics live as long
+		// as the bus, so the pointer
+		// can be kept and published to
+		//******************************
+		inline EventTopic* Open(const char* topic) noexcept
+		{
+			EventTopic* t = Find(topic);
+			if (t != nullptr)
+				return t;
+			std::lock_guard<std::shared_timed_mutex> lock(m_lock);
+			std::unique_ptr<EventTopic>& created = m_topics[topic];
+			if (created == nullptr)
+				created.reset(new EventTopic());
+			return created.get();
+		}
+	private:
+		//******************************
+		// Existing topic getter, does
+		// not create the topic. Lookups
+		// share the lock, only creating
+		// a topic takes it exclusively
+		//******************************
+		inline EventTopic* Find(const char* topic) noexcept
+		{
+			assert(topic != nullptr);
+			std::shared_lock<std::shared_timed_mutex> lock(m_lock);
+			auto t = m_topics.find(topic);
+			return t == m_topics.end() ? nullptr : t->second.get();
+		}
+
+		std::shared_timed_mutex m_lock;
+		std::unordered_map<std::string, std::unique_ptr<EventTopic>> m_topics = {};
+	};
+}
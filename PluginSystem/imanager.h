@@ -10,16 +10,118 @@
 //**************************************
 #pragma once
 
+// required for assert
+#include <assert.h>
+// required for uint64_t
+#include <cstdint>
 // required for std::shared_ptr
 #include <memory>
+// required for std::string
+#include <string>
 // required for std::vector
 #include <vector>
+// required for std::is_trivially_copyable
+#include <type_traits>
 
 // the version of the plugin manager this was designed for
 #define VERSION		0.0;
 
 namespace Plugin
 {
+	// the largest event that can be published to a topic
+	const size_t MAX_EVENT_SIZE = 64;
+
+	//**********************************
+	// Backpressure counters for a
+	// single topic
+	//**********************************
+	struct TopicStats
+	{
+		// events currently waiting to be delivered
+		size_t depth = 0;
+		// the most events the topic can hold
+		size_t capacity = 0;
+		// events accepted into the queue
+		uint64_t published = 0;
+		// events handed to the subscribers
+		uint64_t delivered = 0;
+		// events rejected because the queue was full
+		// or nobody had subscribed yet
+		uint64_t dropped = 0;
+	};
+
+	//**********************************
+	// A topic looked up once by name,
+	// publishing through it skips the
+	// lookup entirely
+	//**********************************
+	struct TopicHandle
+	{
+		void* topic = nullptr;
+	};
+
+	//**********************************
+	// How a registered function's
+	// result depends on its input,
+	// the manager may cache results
+	// of handles that are not Impure
+	//**********************************
+	enum class Purity
+	{
+		// may read or change outside state (the default)
+		Impure,
+		// the result depends only on the arguments, calls taking
+		// anything but numbers and enums are never cached
+		Pure,
+		// the result never changes
+		Constant,
+	};
+
+	//**********************************
+	// How long memory handed out by
+	// the manager lives before the
+	// host frees it in bulk
+	//**********************************
+	enum class AllocScope
+	{
+		// until the host is done with the result of the current call,
+		// or for a subscriber until its batch is delivered
+		Call,
+		// until the host finishes drawing the current frame on this
+		// thread, or for a subscriber until its batch is delivered
+		Frame,
+		// until the plugin is unloaded
+		Plugin,
+	};
+
+	//**********************************
+	// A pointer and a count, used to
+	// hand results built in host
+	// memory back to the host
+	//**********************************
+	template<typename T>
+	struct Span
+	{
+		T* data;
+		size_t size;
+
+		inline T* begin() const noexcept { return data; }
+		inline T* end() const noexcept { return data + size; }
+	};
+
+	//**********************************
+	// A single staged change made in a
+	// registration Transaction
+	//**********************************
+	struct RegistrationOp
+	{
+		const char* handle;
+		void* function;
+		Purity purity;
+		// true to register, false to unregister
+		bool attach;
+	};
+
 	//**********************************
 	// Abstract base class, used for
 	// erasing the type contained in
@@ -33,6 +135,119 @@ namespace Plugin
 		virtual void Unregister(const char*, void*) const noexcept = 0;
 		// IOC Function getter
 		virtual std::vector<void*> PluginFunctions(const char* handle) const noexcept = 0;
+		// Event publish method
+		virtual size_t Publish(const char* topic, const void* events, size_t size, size_t count) const noexcept = 0;
+		// Event subscribe method
+		virtual void Subscribe(const char* topic, void* function) const noexcept = 0;
+		// Event unsubscribe method
+		virtual void Unsubscribe(const char* topic, void* function) const noexcept = 0;
+		// IOC Register method with purity
+		virtual void Register(const char*, void*, Purity) const noexcept = 0;
+		// Host arena allocation method
+		virtual void* Allocate(size_t size, size_t align, AllocScope scope) const noexcept = 0;
+		// Host pool allocation method
+		virtual void* AllocateObject(size_t size) const noexcept = 0;
+		// Host pool free method
+		virtual void FreeObject(void* object, size_t size) const noexcept = 0;
+		// Renderer dirty region method
+		virtual void MarkDirty(int x, int y, int w, int h) const noexcept = 0;
+		// IOC batched Register/Unregister method
+		virtual void Commit(const RegistrationOp* ops, size_t count) const noexcept = 0;
+		// Event topic lookup method
+		virtual void* OpenTopic(const char* topic) const noexcept = 0;
+		// Event publish method for a looked up topic
+		virtual size_t Publish(void* topic, const void* events, size_t size, size_t count) const noexcept = 0;
+		// Event counters method
+		virtual TopicStats GetTopicStats(void* topic) const noexcept = 0;
+		// models are deleted through this base
+		virtual ~ManagerConcept() noexcept {}
+	};
+
+	//**********************************
+	// Stages a plugin's registrations
+	// so the manager can apply them all
+	// at once: one lock, one pass over
+	// each handle and one invalidation
+	// of anything cached, instead of
+	// one of each per handle
+	//**********************************
+	class Transaction final
+	{
+	public:
+		//******************************
+		// Ctor takes the manager to
+		// commit to, use IManager::Begin
+		//******************************
+		inline Transaction(std::shared_ptr<ManagerConcept> manager) noexcept : m_manager(manager) { }
+
+		//******************************
+		// Every staged change must be
+		// committed before this goes
+		// out of scope
+		//******************************
+		inline ~Transaction() noexcept { assert(m_ops.empty()); }
+
+		//******************************
+		// Stage a Register
+		//******************************
+		inline Transaction& Register(const char* handle, void* function, Purity purity = Purity::Impure)
+		{
+			Stage(handle, function, purity, true);
+			return *this;
+		}
+
+		//******************************
+		// Stage an Unregister
+		//******************************
+		inline Transaction& Unregister(const char* handle, void* function)
+		{
+			Stage(handle, function, Purity::Impure, false);
+			return *this;
+		}
+
+		//******************************
+		// Apply everything staged, with
+		// the same result as making the
+		// calls in the order staged
+		//******************************
+		inline void Commit() noexcept
+		{
+			std::vector<RegistrationOp> ops;
+			ops.reserve(m_ops.size());
+			for (const Staged& op : m_ops)
+				ops.push_back({ m_names.c_str() + op.name, op.function, op.purity, op.attach });
+			m_manager->Commit(ops.data(), ops.size());
+			m_ops.clear();
+			m_names.clear();
+		}
+	private:
+		//******************************
+		// A staged change, the name is
+		// copied since it may not live
+		// until Commit. Names are kept
+		// back to back in m_names, each
+		// ending in a null, so staging
+		// doesn't allocate per change
+		//******************************
+		struct Staged
+		{
+			size_t name;
+			void* function;
+			Purity purity;
+			bool attach;
+		};
+
+		inline void Stage(const char* handle, void* function, Purity purity, bool attach)
+		{
+			assert(handle != nullptr);
+			m_ops.push_back({ m_names.size(), function, purity, attach });
+			m_names.append(handle);
+			m_names.push_back('\0');
+		}
+
+		std::shared_ptr<ManagerConcept> m_manager;
+		std::vector<Staged> m_ops = {};
+		std::string m_names = {};
 	};
 
 	//**********************************
@@ -58,12 +273,25 @@ namespace Plugin
 		//******************************
 		inline void Register(const char* handle, void* function) const noexcept { m_manager->Register(handle, function); }
 
+		//******************************
+		// Register passthrough method
+		// that also tells the manager
+		// whether it may cache results
+		//******************************
+		inline void Register(const char* handle, void* function, Purity purity) const noexcept { m_manager->Register(handle, function, purity); }
+
 		//******************************
 		// Unregister passthrough method
 		// using the Manager interface
 		//******************************
 		inline void Unregister(const char* handle, void* function) const noexcept { m_manager->Unregister(handle, function); }
 
+		//******************************
+		// Start staging registrations
+		// to commit all at once
+		//******************************
+		inline Transaction Begin() const noexcept { return Transaction(m_manager); }
+
 		//******************************
 		// Plugin function getter method
 		// Useful for using functions
@@ -78,6 +306,108 @@ namespace Plugin
 			for (void* f : _f) r.push_back(static_cast<FuncType>(f));
 			return r;
 		}
+
+		//******************************
+		// Publish a batch of events to
+		// a topic without waiting on
+		// its subscribers. Returns how
+		// many were accepted, the rest
+		// were dropped
+		//******************************
+		template<typename Event>
+		inline size_t Publish(const char* topic, const Event* events, size_t count) const noexcept
+		{
+			static_assert(std::is_trivially_copyable<Event>::value, "IManager::Publish requires a trivially copyable event");
+			static_assert(sizeof(Event) <= MAX_EVENT_SIZE, "IManager::Publish requires an event no larger than MAX_EVENT_SIZE");
+			return m_manager->Publish(topic, events, sizeof(Event), count);
+		}
+
+		//******************************
+		// Publish a single event
+		//******************************
+		template<typename Event>
+		inline bool Publish(const char* topic, const Event& event) const noexcept { return Publish(topic, &event, 1) == 1; }
+
+		//******************************
+		// Look a topic up once, for
+		// plugins that publish to it
+		// often
+		//******************************
+		inline TopicHandle OpenTopic(const char* topic) const noexcept { return { m_manager->OpenTopic(topic) }; }
+
+		//******************************
+		// Publish a batch of events to
+		// a topic from OpenTopic
+		//******************************
+		template<typename Event>
+		inline size_t Publish(TopicHandle topic, const Event* events, size_t count) const noexcept
+		{
+			static_assert(std::is_trivially_copyable<Event>::value, "IManager::Publish requires a trivially copyable event");
+			static_assert(sizeof(Event) <= MAX_EVENT_SIZE, "IManager::Publish requires an event no larger than MAX_EVENT_SIZE");
+			return m_manager->Publish(topic.topic, events, sizeof(Event), count);
+		}
+
+		//******************************
+		// Publish a single event to a
+		// topic from OpenTopic
+		//******************************
+		template<typename Event>
+		inline bool Publish(TopicHandle topic, const Event& event) const noexcept { return Publish(topic, &event, 1) == 1; }
+
+		//******************************
+		// Queue depth and drop counters
+		// for a topic from OpenTopic
+		//******************************
+		inline TopicStats GetTopicStats(TopicHandle topic) const noexcept { return m_manager->GetTopicStats(topic.topic); }
+
+		//******************************
+		// Subscribe passthrough method,
+		// function must be of the form
+		// void(const void*, size_t) and
+		// is called on the topic's own
+		// consumer thread
+		//******************************
+		inline void Subscribe(const char* topic, void* function) const noexcept { m_manager->Subscribe(topic, function); }
+
+		//******************************
+		// Unsubscribe passthrough method
+		//******************************
+		inline void Unsubscribe(const char* topic, void* function) const noexcept { m_manager->Unsubscribe(topic, function); }
+
+		//******************************
+		// Allocate count objects in
+		// host memory that the host
+		// frees in bulk at the end of
+		// scope. Destructors are never
+		// run, so T must be trivial
+		//******************************
+		template<typename T>
+		inline Span<T> Allocate(size_t count, AllocScope scope = AllocScope::Call) const noexcept
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "IManager::Allocate requires a trivially destructible type");
+			return { static_cast<T*>(m_manager->Allocate(sizeof(T) * count, alignof(T), scope)), count };
+		}
+
+		//******************************
+		// Allocate a single object from
+		// this plugin's pools, it lives
+		// until freed or unloaded
+		//******************************
+		inline void* AllocateObject(size_t size) const noexcept { return m_manager->AllocateObject(size); }
+
+		//******************************
+		// Free an object allocated by
+		// AllocateObject
+		//******************************
+		inline void FreeObject(void* object, size_t size) const noexcept { m_manager->FreeObject(object, size); }
+
+		//******************************
+		// Have the host repaint a
+		// region of the map on its
+		// next frame, for plugins that
+		// draw on the terminal directly
+		//******************************
+		inline void MarkDirty(int x, int y, int w, int h) const noexcept { m_manager->MarkDirty(x, y, w, h); }
 	private:
 		// shared pointer to the base class
 		// to utilize polymorphism without
@@ -104,4 +434,12 @@ namespace Plugin
 #define DLL_MAIN(M)		PLUGIN_EXPORT void dll_register(Plugin::IManager M)
 
 // dll exit point, unregsiter handles here
-#define DLL_EXIT(M)		PLUGIN_EXPORT void dll_unregister(Plugin::IManager M)
\ No newline at end of file
+#define DLL_EXIT(M)		PLUGIN_EXPORT void dll_unregister(Plugin::IManager M)
+
+// optional list of handles this plugin registers, used to order
+// plugins loaded together with PluginManager::LoadPlugins
+#define PLUGIN_PROVIDES(...)	PLUGIN_EXPORT const char* const* dll_provides() { static const char* const h[] = { __VA_ARGS__, nullptr }; return h; }
+
+// optional list of handles this plugin needs registered before
+// its entry point runs
+#define PLUGIN_DEPENDS(...)		PLUGIN_EXPORT const char* const* dll_depends() { static const char* const h[] = { __VA_ARGS__, nullptr }; return h; }
\ No newline at end of file
@@ -11,21 +11,48 @@
 #include <functional>
 #include <iostream>
 
+#include "benchmarks.h"
 #include "map.h"
 #include "plugin_manager.h"
 
+#include <Windows.h>
+
+// older SDKs do not define it
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+
 using std::cout;
 const char* endl = "\n";
 
 using namespace Plugin;
 
+//**************************************
+// Have the console act on the ANSI
+// cursor escapes the renderer writes
+// instead of printing them
+//**************************************
+void EnableVirtualTerminal()
+{
+	HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD mode = 0;
+	if (out != INVALID_HANDLE_VALUE && GetConsoleMode(out, &mode))
+		SetConsoleMode(out, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+}
+
 int main()
 {
-	// load our plugin (comment out to not load it)
-	PMgr::GetInstance().LoadPlugin("DemoPlugin.dll");
+	EnableVirtualTerminal();
+
+	// load our plugins (comment out to not load them)
+	PMgr::GetInstance().LoadPlugins({ "DemoPlugin.dll" });
 
 	Map map;
 	map.Draw(10, 10);
 
+#ifdef PLUGIN_BENCHMARKS
+	Benchmarks::RunAll(cout);
+#endif
+
 	return 0;
 }
\ No newline at end of file
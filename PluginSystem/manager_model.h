@@ -27,9 +27,11 @@ namespace Plugin
 		// ctor grabs a reference to
 		// the item passed in and
 		// holds on to it for
-		// dispatching later
+		// dispatching later, along
+		// with the plugin it was
+		// handed to (if any)
 		//******************************
-		inline ManagerModel(Type& manager) noexcept : m_manager(manager) { }
+		inline ManagerModel(Type& manager, void* plugin = nullptr) noexcept : m_manager(manager), m_plugin(plugin) { }
 
 		//******************************
 		// Final passthrough Register
@@ -43,6 +45,26 @@ namespace Plugin
 			m_manager.Register(handle, function);
 		}
 
+		//******************************
+		// Final passthrough Register
+		// function for handlers that
+		// declare their purity
+		//******************************
+		virtual inline void Register(const char* handle, void* function, Purity purity) const noexcept override
+		{
+			m_manager.Register(handle, function, purity);
+		}
+
+		//******************************
+		// Final passthrough Commit
+		// function, used for applying
+		// a whole Transaction at once
+		//******************************
+		virtual inline void Commit(const RegistrationOp* ops, size_t count) const noexcept override
+		{
+			m_manager.Commit(ops, count);
+		}
+
 		//******************************
 		// Final passthrough Unregister
 		// function, used for removing
@@ -67,7 +89,108 @@ namespace Plugin
 			return m_manager.GetPluginFuncs(handle);
 		}
 
+		//******************************
+		// Final passthrough Publish
+		// function, used for sending
+		// events to other plugins
+		//******************************
+		virtual size_t Publish(const char* topic, const void* events, size_t size, size_t count) const noexcept override
+		{
+			return m_manager.Publish(topic, events, size, count);
+		}
+
+		//******************************
+		// Final passthrough Subscribe
+		// function, used for receiving
+		// events from other plugins
+		//******************************
+		virtual void Subscribe(const char* topic, void* function) const noexcept override
+		{
+			m_manager.Subscribe(topic, function);
+		}
+
+		//******************************
+		// Final passthrough Unsubscribe
+		// function, used for removing
+		// a subscriber when this plugin
+		// is unloaded
+		//******************************
+		virtual void Unsubscribe(const char* topic, void* function) const noexcept override
+		{
+			m_manager.Unsubscribe(topic, function);
+		}
+
+		//******************************
+		// Final passthrough Allocate
+		// function, used for building
+		// results in host memory
+		//******************************
+		virtual void* Allocate(size_t size, size_t align, AllocScope scope) const noexcept override
+		{
+			return m_manager.Allocate(size, align, scope, m_plugin);
+		}
+
+		//******************************
+		// Final passthrough object
+		// allocation function
+		//******************************
+		virtual void* AllocateObject(size_t size) const noexcept override
+		{
+			return m_manager.AllocateObject(size, m_plugin);
+		}
+
+		//******************************
+		// Final passthrough object
+		// free function
+		//******************************
+		virtual void FreeObject(void* object, size_t size) const noexcept override
+		{
+			m_manager.FreeObject(object, size, m_plugin);
+		}
+
+		//******************************
+		// Final passthrough topic
+		// lookup function
+		//******************************
+		virtual void* OpenTopic(const char* topic) const noexcept override
+		{
+			return m_manager.OpenTopic(topic);
+		}
+
+		//******************************
+		// Final passthrough Publish
+		// function for a looked up
+		// topic
+		//******************************
+		virtual size_t Publish(void* topic, const void* events, size_t size, size_t count) const noexcept override
+		{
+			return m_manager.Publish(topic, events, size, count);
+		}
+
+		//******************************
+		// Final passthrough topic
+		// counters function
+		//******************************
+		virtual TopicStats GetTopicStats(void* topic) const noexcept override
+		{
+			return m_manager.GetTopicStats(topic);
+		}
+
+		//******************************
+		// Final passthrough MarkDirty
+		// function, used for asking
+		// the host to repaint
+		//******************************
+		virtual void MarkDirty(int x, int y, int w, int h) const noexcept override
+		{
+			m_manager.MarkDirty(x, y, w, h);
+		}
+
 		// the type to be erased
 		Type& m_manager;
+
+		// the plugin this model was handed to,
+		// owner of any AllocScope::Plugin memory
+		void* m_plugin;
 	};
 }
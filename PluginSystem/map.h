@@ -8,60 +8,177 @@
 //**************************************
 #pragma once
 
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <utility>
 
+#include "alias_table.h"
 #include "plugin_manager.h"
 
 class Map
 {
 public:
+	// a symbol and how likely it is relative to the others
+	using WeightedSymbol = std::pair<char, float>;
+
 	Map()
 	{
 		// add any extra characters to our pool of possible characters
-		using FuncType = std::vector<char>(*)();
-		std::vector<FuncType> chars = Plugin::PMgr::GetPluginFuncs<FuncType>("mapSymbols");
-		for (auto f : chars)
-			for(char c : f())
-				m_symbols.push_back(c);
+		// (served from the cache if the plugins registered as constant)
+		Plugin::PMgr& pm = Plugin::PMgr::GetInstance();
+		for (const std::vector<char>& chars : pm.CollectPlugins<std::vector<char>>("mapSymbols"))
+			for(char c : chars)
+				m_symbols.push_back({ c, 1.0f });
+
+		// plugins that want some symbols to show up more or less
+		// often return (symbol, weight) pairs instead of repeating them
+		for (const std::vector<WeightedSymbol>& weighted : pm.CollectPlugins<std::vector<WeightedSymbol>>("mapSymbolsWeighted"))
+			for (const WeightedSymbol& s : weighted)
+				m_symbols.push_back(s);
+
+		// plugins that build their characters in host memory instead
+		// of returning a vector; the call arena is freed right after
+		using ArenaFuncType = Plugin::Span<char>(*)(const Plugin::IManager&);
+		Plugin::IManager host = pm;
+		for (auto f : pm.GetPluginFuncs<ArenaFuncType>("mapSymbolsArena"))
+			for (char c : f(host))
+				m_symbols.push_back({ c, 1.0f });
+		pm.ResetArena(Plugin::AllocScope::Call);
+
+		// build the sampler once, every cell after this is O(1)
+		m_table.Build(m_symbols);
 	}
 
 	void Draw(int w, int h, int seed = -1)
 	{
 		// allow plugins to hijack the rendering
-		if (Plugin::PMgr::GetInstance().GetHandle("drawOverride").Pointers().size() != 0)
+		if (!Override(w, h, seed))
 		{
-			for (auto f : Plugin::PMgr::GetInstance().GetPluginFuncs<void(*)(int, int, int)>("drawOverride"))
+			seed = Reseed(seed);
+
+			// start to generate our map a row at a time
+			std::string row(w, ' ');
+			for (int y{ 0 }; y < h; ++y)
 			{
-				f(w, h, seed);
+				Fill(&row[0], w, seed, y);
+				std::cout.write(row.data(), w);
+				std::cout << '\n';
 			}
 		}
+
+		// anything plugins allocated for this frame is done with
+		Plugin::PMgr::GetInstance().ResetArena(Plugin::AllocScope::Frame);
+	}
+
+	//**************************************
+	// Draw into a retained renderer so
+	// only the cells that changed since
+	// the last frame reach the terminal.
+	// Plugins mark regions dirty on the
+	// renderer the host gave SetRenderer,
+	// which should be this one for as
+	// long as it lives
+	//**************************************
+	void Draw(Plugin::Renderer& renderer, int seed = -1)
+	{
+		Plugin::PMgr& pm = Plugin::PMgr::GetInstance();
+		if (pm.CopyHandle("drawOverride").Pointers().size() != 0)
+		{
+			// repaint what plugins dirtied last frame, then let them
+			// draw over it and mark what they touched for the next one
+			renderer.Present();
+			Override(renderer.Width(), renderer.Height(), seed);
+		}
 		else
 		{
-			// generate a seed if necessary
-			if (seed == -1)
-				seed = rand();
+			// the same seed gives the same frame, so only
+			// what changed between seeds reaches the terminal
+			seed = Reseed(seed);
+			for (int y{ 0 }; y < renderer.Height(); ++y)
+				Fill(renderer.Row(y), renderer.Width(), seed, y);
+			renderer.Present();
+		}
 
-			// execute any plugins that affect the seed
-			// this member function explicitly handles the pattern of
-			// x = func(x), where func is defined as X func(X x)
-			// if no plugins handle this, then it returns x unchanged
-			seed = Plugin::PMgr::GetInstance().ExecutePlugins("seedGeneration", seed);
+		pm.ResetArena(Plugin::AllocScope::Frame);
+	}
 
-			// randomize that many times
-			for (int i = 0; i < seed; ++i) (void)rand();
+	//**************************************
+	// Fill count cells of row y of the
+	// map for seed
+	//**************************************
+	void Fill(char* cells, int count, int seed, int y) const noexcept
+	{
+		for (int i{ 0 }; i < count; ++i)
+			cells[i] = Cell(seed, i, y);
+	}
 
-			// start to generate our map
-			for (int y{ 0 }; y < h; ++y)
-			{
-				for (int x{ 0 }; x < w; ++x)
-				{
-					// put the random symbol in our map
-					std::cout << m_symbols[rand() % m_symbols.size()];
-				}
-				std::cout << '\n';
-			}
-		}
+	//**************************************
+	// The symbol at (x, y) in the map for
+	// seed. Every cell is a hash of its
+	// position, so neighbouring areas
+	// line up and nothing depends on
+	// rand()
+	//**************************************
+	char Cell(int seed, int64_t x, int64_t y) const noexcept
+	{
+		uint64_t h = Mix(static_cast<uint32_t>(seed) ^ Mix(static_cast<uint64_t>(x)));
+		h = Mix(h ^ static_cast<uint64_t>(y));
+		// low bits pick the column, high bits flip the coin
+		double coin = (h >> 11) * (1.0 / 9007199254740992.0);
+		return m_table.Sample(static_cast<size_t>(h & 0xFFFFFFFF), coin);
 	}
+
+	//**************************************
+	// The weighted table used to pick
+	// symbols, for callers that bring
+	// their own random numbers
+	//**************************************
+	const Plugin::AliasTable<char>& Symbols() const noexcept { return m_table; }
 private:
-	std::vector<char> m_symbols = {' ', '^', '.'};
+	//**************************************
+	// Hand the frame to any plugins that
+	// hijack the rendering, returns false
+	// if there are none
+	//**************************************
+	bool Override(int w, int h, int seed)
+	{
+		auto overrides = Plugin::PMgr::GetInstance().GetPluginFuncs<void(*)(int, int, int)>("drawOverride");
+		for (auto f : overrides)
+		{
+			f(w, h, seed);
+		}
+		return overrides.size() != 0;
+	}
+
+	//**************************************
+	// The seed a frame is drawn with,
+	// after letting plugins adjust it
+	//**************************************
+	int Reseed(int seed)
+	{
+		// generate a seed if necessary
+		if (seed == -1)
+			seed = rand();
+
+		// execute any plugins that affect the seed
+		// this member function explicitly handles the pattern of
+		// x = func(x), where func is defined as X func(X x)
+		// if no plugins handle this, then it returns x unchanged
+		return Plugin::PMgr::GetInstance().ExecutePlugins("seedGeneration", seed);
+	}
+
+	//**************************************
+	// splitmix64 finalizer
+	//**************************************
+	static inline uint64_t Mix(uint64_t z) noexcept
+	{
+		z += 0x9E3779B97F4A7C15ull;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	std::vector<WeightedSymbol> m_symbols = { { ' ', 1.0f }, { '^', 1.0f }, { '.', 1.0f } };
+	Plugin::AliasTable<char> m_table;
 };
\ No newline at end of file
@@ -0,0 +1,254 @@
+//**************************************
+// memo_cache.h
+//
+// Holds the declaration for the result
+// cache used to skip calling plugin
+// handlers that were registered as
+// pure or constant
+//
+// Results are keyed on the handle name
+// and the values of the arguments,
+// the cache is bounded and evicts the
+// least recently used result, and the
+// whole handle is dropped whenever its
+// subscribers change
+//
+// Author: Nathan Ikola
+// nathan.ikola@gmail.com
+//**************************************
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Plugin
+{
+	// the most results the manager will keep around
+	const size_t DEFAULT_MEMO_CAPACITY = 4096;
+
+	//**********************************
+	// Hit rate counters for the cache
+	//**********************************
+	struct MemoStats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+		uint64_t invalidations = 0;
+		size_t entries = 0;
+
+		// fraction of lookups that were served from the cache
+		inline double HitRate() const noexcept
+		{
+			uint64_t total = hits + misses;
+			return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+		}
+	};
+
+	//**********************************
+	// Appends the bytes of an argument
+	// to a cache key. Only numbers and
+	// enums can be keyed; a pointer or
+	// a struct that may hold one would
+	// key on an address rather than
+	// on what it points at, so
+	// anything else disables caching
+	//**********************************
+	template<typename T, bool = std::is_arithmetic<T>::value || std::is_enum<T>::value>
+	struct MemoKey
+	{
+		static inline bool Append(std::string& key, const T& value) noexcept
+		{
+			key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+			return true;
+		}
+	};
+
+	template<typename T>
+	struct MemoKey<T, false>
+	{
+		static inline bool Append(std::string&, const T&) noexcept { return false; }
+	};
+
+	class MemoCache final
+	{
+	public:
+		//******************************
+		// Ctor sets the entry limit
+		//******************************
+		inline MemoCache(size_t capacity = DEFAULT_MEMO_CAPACITY) noexcept : m_capacity(capacity) {}
+
+		MemoCache(const MemoCache&) = delete;
+		MemoCache& operator=(const MemoCache&) = delete;
+
+		//******************************
+		// The handle's generation, read
+		// before calling the handlers
+		// and passed to Store so stale
+		// results are discarded
+		//******************************
+		inline uint64_t Generation(const std::string& handle)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			return m_generations[handle];
+		}
+
+		//******************************
+		// Look up a result, returns
+		// false on a miss
+		//******************************
+		template<typename R>
+		bool Find(const std::string& handle, const std::string& key, R& out)
+		{
+			std::shared_ptr<const void> value;
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				auto h = m_handles.find(handle);
+				auto e = h == m_handles.end() ? Bucket::iterator() : h->second.find(key);
+				if (h == m_handles.end() || e == h->second.end() || e->second.type != typeid(R).hash_code())
+				{
+					++m_stats.misses;
+					return false;
+				}
+				// most recently used goes to the front
+				m_lru.splice(m_lru.begin(), m_lru, e->second.lru);
+				value = e->second.value;
+				++m_stats.hits;
+			}
+			// copy the result out without holding the lock
+			out = *static_cast<const R*>(value.get());
+			return true;
+		}
+
+		//******************************
+		// Store a result computed after
+		// a miss. It is discarded if the
+		// handle changed in the meantime
+		//******************************
+		template<typename R>
+		void Store(const std::string& handle, const std::string& key, const R& result, uint64_t generation)
+		{
+			std::shared_ptr<const void> value = std::make_shared<R>(result);
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (m_generations[handle] != generation || m_capacity == 0)
+				return;
+
+			Bucket& bucket = m_handles[handle];
+			auto e = bucket.find(key);
+			if (e != bucket.end())
+			{
+				e->second.value = value;
+				e->second.type = typeid(R).hash_code();
+				m_lru.splice(m_lru.begin(), m_lru, e->second.lru);
+				return;
+			}
+
+			// make room by dropping the least recently used result
+			if (m_lru.size() >= m_capacity)
+			{
+				const Slot& victim = m_lru.back();
+				auto h = m_handles.find(victim.first);
+				h->second.erase(victim.second);
+				if (h->second.empty() && h->first != handle)
+					m_handles.erase(h);
+				m_lru.pop_back();
+				++m_stats.evictions;
+			}
+
+			m_lru.push_front({ handle, key });
+			bucket[key] = { value, typeid(R).hash_code(), m_lru.begin() };
+		}
+
+		//******************************
+		// Drop every result for handle
+		//******************************
+		inline void Invalidate(const std::string& handle)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (Drop(handle))
+				++m_stats.invalidations;
+		}
+
+		//******************************
+		// Drop every result for several
+		// handles under one lock
+		//******************************
+		inline void Invalidate(const std::vector<const std::string*>& handles)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			bool dropped = false;
+			for (const std::string* handle : handles)
+				dropped = Drop(*handle) || dropped;
+			if (dropped)
+				++m_stats.invalidations;
+		}
+
+		//******************************
+		// Drop every result
+		//******************************
+		inline void Clear()
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			for (auto& g : m_generations)
+				++g.second;
+			if (!m_lru.empty())
+				++m_stats.invalidations;
+			m_handles.clear();
+			m_lru.clear();
+		}
+
+		//******************************
+		// Snapshot of the counters
+		//******************************
+		inline MemoStats Stats()
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			MemoStats s = m_stats;
+			s.entries = m_lru.size();
+			return s;
+		}
+	private:
+		// (handle, key) pairs in recency order
+		using Slot = std::pair<std::string, std::string>;
+
+		struct Entry
+		{
+			std::shared_ptr<const void> value;
+			size_t type;
+			std::list<Slot>::iterator lru;
+		};
+		using Bucket = std::unordered_map<std::string, Entry>;
+
+		//******************************
+		// Drop a handle's results and
+		// bump its generation, must be
+		// called with m_lock held
+		//******************************
+		inline bool Drop(const std::string& handle)
+		{
+			++m_generations[handle];
+			auto h = m_handles.find(handle);
+			if (h == m_handles.end())
+				return false;
+			for (auto& e : h->second)
+				m_lru.erase(e.second.lru);
+			m_handles.erase(h);
+			return true;
+		}
+
+		std::mutex m_lock;
+		size_t m_capacity;
+		std::unordered_map<std::string, Bucket> m_handles = {};
+		std::unordered_map<std::string, uint64_t> m_generations = {};
+		std::list<Slot> m_lru = {};
+		MemoStats m_stats;
+	};
+}
@@ -11,10 +11,14 @@
 //**************************************
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
 #include <functional>
+#include <utility>
 #include <vector>
 
+#include "imanager.h"
+
 namespace Plugin
 {
 	class PluginHandle final
@@ -28,7 +32,7 @@ namespace Plugin
 		//************************************
 		// Overload ctor to accept function
 		//************************************
-		inline PluginHandle(void* func) { Attach(func); }
+		inline PluginHandle(void* func, Purity purity = Purity::Impure) { Attach(func, purity); }
 
 		//************************************
 		// Move constructor is acceptable
@@ -36,6 +40,7 @@ namespace Plugin
 		inline PluginHandle(PluginHandle&& rhs) noexcept
 		{
 			m_functions = std::move(rhs.m_functions);
+			m_purity = std::move(rhs.m_purity);
 		}
 
 		//************************************
@@ -43,8 +48,11 @@ namespace Plugin
 		//************************************
 		PluginHandle& operator=(PluginHandle&& rhs) noexcept
 		{
-			if(this != &rhs)
+			if (this != &rhs)
+			{
 				m_functions = std::move(rhs.m_functions);
+				m_purity = std::move(rhs.m_purity);
+			}
 			return *this;
 		}
 
@@ -57,18 +65,19 @@ namespace Plugin
 		//************************************
 		// Default dtor is acceptable
 		//************************************
-		inline ~PluginHandle() noexcept { m_functions.clear(); }
+		inline ~PluginHandle() noexcept { m_functions.clear(); m_purity.clear(); }
 
 		//************************************
 		// Attach a function to this handle
 		//************************************
-		inline void Attach(void* func) noexcept
+		inline void Attach(void* func, Purity purity = Purity::Impure) noexcept
 		{
 			assert(func != nullptr);
 			// check that we do not already have this function
 			for (void* f : m_functions) assert(f != func);
 			// add this function to the working list
 			m_functions.push_back(func);
+			m_purity.push_back(purity);
 		}
 
 		//************************************
@@ -79,6 +88,7 @@ namespace Plugin
 			for (auto iter{ m_functions.begin() }; iter != m_functions.end(); ++iter)
 				if ((*iter) == func)
 				{
+					m_purity.erase(m_purity.begin() + (iter - m_functions.begin()));
 					m_functions.erase(iter);
 					return;
 				}
@@ -88,6 +98,76 @@ namespace Plugin
 			assert(false);
 		}
 
+		//************************************
+		// Apply a handle's share of a
+		// Transaction in the order it was
+		// staged, rebuilding the list once
+		// instead of scanning it once per
+		// function
+		//************************************
+		inline void Apply(const RegistrationOp* const* ops, size_t count) noexcept
+		{
+			// most handles only get one change
+			if (count == 1)
+			{
+				if (ops[0]->attach) Attach(ops[0]->function, ops[0]->purity);
+				else Detach(ops[0]->function);
+				return;
+			}
+
+			// a function attached and then detached within the batch
+			// cancels out, anything else detached must already be here
+			std::vector<std::pair<void*, Purity>> attach;
+			std::vector<void*> detach;
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				if (ops[i]->attach)
+				{
+					attach.push_back({ ops[i]->function, ops[i]->purity });
+					continue;
+				}
+				auto a = std::find_if(attach.begin(), attach.end(), [&](const std::pair<void*, Purity>& p) { return p.first == ops[i]->function; });
+				if (a != attach.end())
+					attach.erase(a);
+				else
+					detach.push_back(ops[i]->function);
+			}
+
+			if (!detach.empty())
+			{
+				size_t kept = 0;
+				for (size_t i{ 0 }; i < m_functions.size(); ++i)
+				{
+					bool dropped = false;
+					for (void* d : detach)
+						if (m_functions[i] == d) { dropped = true; break; }
+					if (dropped) continue;
+					m_functions[kept] = m_functions[i];
+					m_purity[kept] = m_purity[i];
+					++kept;
+				}
+				// every detached function should have been attached
+				assert(m_functions.size() - kept == detach.size());
+				m_functions.resize(kept);
+				m_purity.resize(kept);
+			}
+
+			m_functions.reserve(m_functions.size() + attach.size());
+			m_purity.reserve(m_purity.size() + attach.size());
+			for (const auto& a : attach)
+			{
+				assert(a.first != nullptr);
+				m_functions.push_back(a.first);
+				m_purity.push_back(a.second);
+			}
+#ifndef NDEBUG
+			// check that no function was attached twice
+			for (size_t i{ 0 }; i < m_functions.size(); ++i)
+				for (size_t j{ i + 1 }; j < m_functions.size(); ++j)
+					assert(m_functions[i] != m_functions[j]);
+#endif
+		}
+
 		//************************************
 		// Return a vector of function
 		// pointers, specified by FuncPtr
@@ -111,7 +191,25 @@ namespace Plugin
 		// pointers
 		//******************************
 		inline std::vector<void*> Pointers() const noexcept { return m_functions; }
+
+		//******************************
+		// The least pure of all the
+		// attached functions, an empty
+		// handle is trivially constant
+		//******************************
+		inline Purity GetPurity() const noexcept
+		{
+			Purity r = Purity::Constant;
+			for (Purity p : m_purity)
+			{
+				if (p == Purity::Impure) return Purity::Impure;
+				if (p == Purity::Pure) r = Purity::Pure;
+			}
+			return r;
+		}
 	private:
 		std::vector<void*> m_functions = {};
+		// parallel to m_functions
+		std::vector<Purity> m_purity = {};
 	};
 }
\ No newline at end of file
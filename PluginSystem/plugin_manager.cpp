@@ -9,12 +9,252 @@
 //************************************
 #include "plugin_manager.h"
 
+#include <chrono>
+#include <functional>
+#include <thread>
+
 #include <Windows.h>
 
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	//************************************
+	// Split the plugins LoadPlugins could
+	// not reach into the cycles they form
+	// and the ones merely waiting on them,
+	// by finding the strongly connected
+	// components of what is left
+	//************************************
+	void ReportCycles(const std::vector<const char*>& filenames, const std::vector<std::vector<size_t>>& dependants,
+		const std::vector<size_t>& pending, Plugin::InitReport& report)
+	{
+		const size_t n = filenames.size();
+		const size_t unvisited = n;
+		std::vector<size_t> index(n, unvisited), low(n, 0), stack;
+		std::vector<bool> onStack(n, false);
+		std::vector<size_t> blocked;
+		size_t next = 0;
+
+		// Tarjan's algorithm, plugin counts are small enough to recurse
+		std::function<void(size_t)> visit = [&](size_t v)
+		{
+			index[v] = low[v] = next++;
+			stack.push_back(v);
+			onStack[v] = true;
+			for (size_t w : dependants[v])
+			{
+				if (pending[w] == 0) continue;
+				if (index[w] == unvisited)
+				{
+					visit(w);
+					low[v] = std::min(low[v], low[w]);
+				}
+				else if (onStack[w])
+					low[v] = std::min(low[v], index[w]);
+			}
+			if (low[v] != index[v])
+				return;
+
+			std::vector<size_t> component;
+			size_t w;
+			do
+			{
+				w = stack.back();
+				stack.pop_back();
+				onStack[w] = false;
+				component.push_back(w);
+			} while (w != v);
+
+			// a plugin on its own is only blocked, its own handles
+			// never count as a dependency
+			if (component.size() == 1)
+			{
+				blocked.push_back(v);
+				return;
+			}
+			std::sort(component.begin(), component.end());
+			std::vector<std::string> cycle;
+			for (size_t c : component)
+				cycle.push_back(filenames[c]);
+			report.cycles.push_back(cycle);
+		};
+
+		for (size_t i{ 0 }; i < n; ++i)
+			if (pending[i] != 0 && index[i] == unvisited)
+				visit(i);
+		std::sort(blocked.begin(), blocked.end());
+		for (size_t b : blocked)
+			report.blocked.push_back(filenames[b]);
+	}
+
+	//************************************
+	// Read a null terminated list of
+	// handle names exported by a plugin,
+	// plugins that do not export it
+	// provide or depend on nothing
+	//************************************
+	std::vector<std::string> HandleList(HINSTANCE dll, const char* name) noexcept
+	{
+		std::vector<std::string> r;
+		FARPROC _list = GetProcAddress(dll, name);
+		if (_list == nullptr)
+			return r;
+		const char* const* list = reinterpret_cast<const char* const* (*)()>(_list)();
+		for (; list != nullptr && *list != nullptr; ++list)
+			r.push_back(*list);
+		return r;
+	}
+}
+
 //************************************
 // Load in the plugin at filename
 //************************************
 void Plugin::PluginManager::LoadPlugin(const char* filename) noexcept
+{
+	void* dll = OpenPlugin(filename);
+
+	// now that we know it is good, add it to our list
+	// of loaded plugins, in a wave of its own
+	m_plugins.push_back(dll);
+	m_waves.push_back({ dll });
+
+	InitPlugin(dll);
+}
+
+//************************************
+// Load a set of plugins in dependency
+// order, one wave at a time
+//************************************
+Plugin::InitReport Plugin::PluginManager::LoadPlugins(const std::vector<const char*>& filenames) noexcept
+{
+	InitReport report;
+	Clock::time_point start = Clock::now();
+
+	// open everything up front, LoadLibrary serializes anyway
+	const size_t n = filenames.size();
+	std::vector<void*> dlls(n);
+	std::vector<std::vector<std::string>> provides(n);
+	for (size_t i{ 0 }; i < n; ++i)
+	{
+		dlls[i] = OpenPlugin(filenames[i]);
+		provides[i] = HandleList(static_cast<HINSTANCE>(dlls[i]), DLLPROVIDES);
+	}
+
+	// an edge runs from each provider of a handle to every plugin
+	// that depends on it; handles nobody in this batch provides are
+	// assumed to come from the host or an already loaded plugin
+	std::unordered_map<std::string, std::vector<size_t>> providers;
+	for (size_t i{ 0 }; i < n; ++i)
+		for (const std::string& h : provides[i])
+			providers[h].push_back(i);
+
+	std::vector<std::vector<size_t>> dependants(n), dependencies(n);
+	std::vector<size_t> pending(n, 0);
+	for (size_t i{ 0 }; i < n; ++i)
+		for (const std::string& h : HandleList(static_cast<HINSTANCE>(dlls[i]), DLLDEPENDS))
+		{
+			auto p = providers.find(h);
+			if (p == providers.end()) continue;
+			for (size_t from : p->second)
+			{
+				if (from == i) continue;
+				dependants[from].push_back(i);
+				dependencies[i].push_back(from);
+				++pending[i];
+			}
+		}
+
+	// the first wave is everything with no dependencies in the batch
+	std::vector<size_t> wave;
+	for (size_t i{ 0 }; i < n; ++i)
+		if (pending[i] == 0) wave.push_back(i);
+
+	std::vector<double> duration(n, 0.0);
+	std::vector<std::vector<StagedOp>> staged(n);
+	std::vector<size_t> order;
+	while (!wave.empty())
+	{
+		// plugins in a wave are always handled in filename order
+		std::sort(wave.begin(), wave.end());
+
+		// initialize the whole wave in parallel, holding back what
+		// each plugin registers so threads do not race to attach
+		std::vector<std::thread> workers;
+		for (size_t i : wave)
+			workers.emplace_back([this, i, &dlls, &duration, &staged]
+			{
+				Clock::time_point begin = Clock::now();
+				Staging() = &staged[i];
+				InitPlugin(dlls[i]);
+				Staging() = nullptr;
+				duration[i] = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+			});
+		for (std::thread& t : workers)
+			t.join();
+
+		// then apply the registrations in filename order, so handles
+		// shared by several plugins always list them the same way
+		std::vector<RegistrationOp> ops;
+		for (size_t i : wave)
+			for (const StagedOp& op : staged[i])
+				ops.push_back({ op.handle.c_str(), op.function, op.purity, op.attach });
+		Commit(ops.data(), ops.size());
+
+		// the next wave is whatever this one unblocked
+		std::vector<void*> loaded;
+		std::vector<size_t> next;
+		for (size_t i : wave)
+		{
+			order.push_back(i);
+			loaded.push_back(dlls[i]);
+			m_plugins.push_back(dlls[i]);
+			for (size_t d : dependants[i])
+				if (--pending[d] == 0) next.push_back(d);
+		}
+		m_waves.push_back(loaded);
+		++report.waves;
+		wave.swap(next);
+	}
+
+	// anything never reached is part of, or waiting on, a cycle
+	ReportCycles(filenames, dependants, pending, report);
+	for (size_t i{ 0 }; i < n; ++i)
+		if (pending[i] != 0)
+			FreeLibrary(static_cast<HINSTANCE>(dlls[i]));
+
+	// the critical path is the chain of dependencies that took the
+	// longest end to end, walked in the order plugins were initialized
+	std::vector<double> finish(n, 0.0);
+	std::vector<size_t> previous(n, n);
+	size_t last = n;
+	for (size_t i : order)
+	{
+		// a plugin is ready once its slowest dependency finished
+		double ready = 0.0;
+		for (size_t d : dependencies[i])
+			if (previous[i] == n || finish[d] > ready)
+			{
+				ready = finish[d];
+				previous[i] = d;
+			}
+		finish[i] = ready + duration[i];
+		if (last == n || finish[i] > finish[last])
+			last = i;
+	}
+	for (size_t i{ last }; i != n; i = previous[i])
+		report.criticalPath.insert(report.criticalPath.begin(), filenames[i]);
+	if (last != n)
+		report.criticalPathMs = finish[last];
+
+	report.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return report;
+}
+
+//************************************
+// Load and check the DLL at filename
+//************************************
+void* Plugin::PluginManager::OpenPlugin(const char* filename) noexcept
 {
 	// double check our input
 	assert(filename != nullptr);
@@ -38,20 +278,47 @@ void Plugin::PluginManager::LoadPlugin(const char* filename) noexcept
 
 	// load the methods we need
 	FARPROC _dllVersion = GetProcAddress(dll, DLLVERSION);
-	FARPROC _dllEntry = GetProcAddress(dll, DLLENTRY);
 
 	// check that the version matches
 	float (*dllVersion)() = reinterpret_cast<float (*)()>(_dllVersion);
 	// ensure the plugin is compatible
 	assert(dllVersion() <= VERSION && dllVersion() >= MIN_VERSION);
 
-	// now that we know it is good, add it to our list
-	// of loaded plugins
-	m_plugins.push_back(dll);
+	return dll;
+}
 
-	// run the register method
+//************************************
+// Run a loaded plugin's entry point
+//************************************
+void Plugin::PluginManager::InitPlugin(void* plugin) noexcept
+{
+	HINSTANCE dll = static_cast<HINSTANCE>(plugin);
+	FARPROC _dllEntry = GetProcAddress(dll, DLLENTRY);
+	assert(_dllEntry != nullptr);
+
+	// run the register method, handing it a manager
+	// that knows which plugin owns its allocations
 	void (*dllEntry)(IManager) = reinterpret_cast<void (*)(IManager)>(_dllEntry);
-	dllEntry(PMgr::GetInstance());
+	dllEntry(IManager(new ManagerModel<PluginManager>(*this, plugin)));
+}
+
+//**************************************
+// Unload every plugin a wave at a time,
+// newest wave first, so nothing is
+// torn down before its dependants
+//**************************************
+Plugin::PluginManager::~PluginManager() noexcept
+{
+	while (m_waves.size() != 0)
+	{
+		std::vector<std::thread> workers;
+		for (void* plugin : m_waves.back())
+			workers.emplace_back([this, plugin] { UnloadPlugin(plugin); });
+		for (std::thread& t : workers)
+			t.join();
+		m_waves.pop_back();
+	}
+	m_plugins.clear();
 }
 
 //**************************************
@@ -69,7 +336,16 @@ void Plugin::PluginManager::UnloadPlugin(void* plugin) noexcept
 	// run this plugin's cleanup method
 	FARPROC _dllExit = GetProcAddress(dll, DLLEXIT);
 	assert(_dllExit != nullptr);
-	reinterpret_cast<void(*)(IManager)>(_dllExit)(PMgr::GetInstance());
+	reinterpret_cast<void(*)(IManager)>(_dllExit)(IManager(new ManagerModel<PluginManager>(*this, dll)));
+
+	// a cached result may still point into this plugin
+	m_memo.Clear();
+
+	// free everything the plugin allocated from the host
+	{
+		std::lock_guard<std::mutex> lock(m_allocLock);
+		m_pluginAllocators.erase(plugin);
+	}
 
 	// make sure the plugin was successfully freed
 	assert(FreeLibrary(dll));
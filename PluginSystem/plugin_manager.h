@@ -17,18 +17,26 @@
 //**************************************
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
 #include <cstdint>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
+#include "arena.h"
+#include "event_bus.h"
 #include "imanager.h"
 #include "manager_model.h"
+#include "memo_cache.h"
 #include "plugin_handle.h"
+#include "renderer.h"
 
 #define DLLVERSION	"dll_version"
 #define DLLENTRY	"dll_register"
 #define DLLEXIT		"dll_unregister"
+#define DLLPROVIDES	"dll_provides"
+#define DLLDEPENDS	"dll_depends"
 
 namespace Plugin
 {
@@ -37,6 +45,27 @@ namespace Plugin
 	// portion is the minor number
 	using version = float;
 
+	//************************************
+	// Timing of a batch of plugins
+	// initialized by LoadPlugins
+	//************************************
+	struct InitReport
+	{
+		// number of waves the plugins were split into
+		size_t waves = 0;
+		// wall clock time for the whole batch
+		double totalMs = 0.0;
+		// the slowest chain of dependent plugins and its length
+		std::vector<std::string> criticalPath = {};
+		double criticalPathMs = 0.0;
+		// plugins left unloaded because they depend on each other,
+		// one list per cycle
+		std::vector<std::vector<std::string>> cycles = {};
+		// plugins left unloaded because something they depend
+		// on is part of, or waiting on, a cycle
+		std::vector<std::string> blocked = {};
+	};
+
 	class PluginManager final
 	{
 	public:
@@ -62,33 +91,42 @@ namespace Plugin
 		//************************************
 		void LoadPlugin(const char* filename) noexcept;
 
+		//************************************
+		// Load a set of plugins, running
+		// their entry points in parallel
+		// waves ordered by the handles
+		// they provide and depend on. What
+		// a wave registers is applied once
+		// it finishes, in filename order
+		//************************************
+		InitReport LoadPlugins(const std::vector<const char*>& filenames) noexcept;
+
 		//************************************
 		// Unload the specified plugin
 		//************************************
 		void UnloadPlugin(void* plugin) noexcept;
 
 		//************************************
-		// Default destructor is acceptable
+		// Dtor unloads every plugin, in the
+		// reverse of the order they were
+		// initialized in
 		//************************************
-		inline ~PluginManager() noexcept 
-		{
-			while (m_plugins.size() != 0)
-			{
-				auto first = m_plugins.begin();
-				UnloadPlugin(*(first));
-				m_plugins.erase(first);
-			}
-		}
+		~PluginManager() noexcept;
 
 		//************************************
 		// Plugin register function
 		//************************************
-		inline void Register(const char* handle, void* func) noexcept
+		inline void Register(const char* handle, void* func, Purity purity = Purity::Impure) noexcept
 		{
+			if (Stage(handle, func, purity, true))
+				return;
+			std::lock_guard<std::mutex> lock(m_handleLock);
 			if (m_handles.find(handle) == m_handles.end())
-				m_handles.insert({ handle, func });
+				m_handles.insert({ handle, PluginHandle(func, purity) });
 			else
-				m_handles[handle].Attach(func);
+				m_handles[handle].Attach(func, purity);
+			// cached results no longer reflect every subscriber
+			m_memo.Invalidate(handle);
 		}
 
 		//************************************
@@ -96,18 +134,92 @@ namespace Plugin
 		//************************************
 		inline void Unregister(const char* handle, void* func) noexcept
 		{
+			if (Stage(handle, func, Purity::Impure, false))
+				return;
+			std::lock_guard<std::mutex> lock(m_handleLock);
 			assert(m_handles.find(handle) != m_handles.end());
 			m_handles[handle].Detach(func);
+			m_memo.Invalidate(handle);
 		}
 
 		//************************************
-		// Handle getter
+		// Apply a batch of registrations
+		// from a Transaction under a single
+		// lock, touching each handle once
 		//************************************
-		inline const PluginHandle& GetHandle(const char* handle) noexcept
+		inline void Commit(const RegistrationOp* ops, size_t count) noexcept
 		{
-			if (m_handles.find(handle) == m_handles.end())
-				m_handles[handle] = {};
-			return m_handles.at(handle);
+			if (count == 0)
+				return;
+			if (Staging() != nullptr)
+			{
+				for (size_t i{ 0 }; i < count; ++i)
+					Stage(ops[i].handle, ops[i].function, ops[i].purity, ops[i].attach);
+				return;
+			}
+
+			// group the changes by handle, keeping each handle's in
+			// the order they were staged, so each handle is looked up
+			// and rebuilt once however many changes it has. The groups
+			// are found through an open addressed table of indices
+			// into handles, so the batch makes one allocation for it
+			// rather than one per change
+			size_t slots = 16;
+			while (slots < count * 2)
+				slots <<= 1;
+			std::vector<size_t> group(slots, SIZE_MAX);
+			std::vector<PluginHandle*> handles;
+			std::vector<const std::string*> touched;
+			std::vector<size_t> groupOf(count);
+
+			std::lock_guard<std::mutex> lock(m_handleLock);
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				assert(ops[i].handle != nullptr);
+				auto h = m_handles.find(ops[i].handle);
+				if (h == m_handles.end())
+					h = m_handles.emplace(ops[i].handle, PluginHandle()).first;
+				PluginHandle* handle = &h->second;
+				size_t slot = static_cast<size_t>((reinterpret_cast<uintptr_t>(handle) >> 4) * 0x9E3779B97F4A7C15ull) & (slots - 1);
+				while (group[slot] != SIZE_MAX && handles[group[slot]] != handle)
+					slot = (slot + 1) & (slots - 1);
+				if (group[slot] == SIZE_MAX)
+				{
+					group[slot] = handles.size();
+					handles.push_back(handle);
+					touched.push_back(&h->first);
+				}
+				groupOf[i] = group[slot];
+			}
+
+			// lay each handle's changes out side by side, in order
+			std::vector<size_t> offset(handles.size() + 1, 0);
+			for (size_t g : groupOf)
+				++offset[g + 1];
+			for (size_t g{ 0 }; g < handles.size(); ++g)
+				offset[g + 1] += offset[g];
+			std::vector<const RegistrationOp*> grouped(count);
+			std::vector<size_t> cursor(offset.begin(), offset.end() - 1);
+			for (size_t i{ 0 }; i < count; ++i)
+				grouped[cursor[groupOf[i]]++] = &ops[i];
+
+			for (size_t g{ 0 }; g < handles.size(); ++g)
+				handles[g]->Apply(&grouped[offset[g]], offset[g + 1] - offset[g]);
+
+			// one invalidation for the whole batch
+			m_memo.Invalidate(touched);
+		}
+
+		//************************************
+		// Handle getter, returns a copy so
+		// it stays valid while plugins are
+		// registering on other threads
+		//************************************
+		inline PluginHandle CopyHandle(const char* handle) noexcept
+		{
+			std::lock_guard<std::mutex> lock(m_handleLock);
+			auto h = m_handles.find(handle);
+			return h == m_handles.end() ? PluginHandle() : h->second;
 		}
 
 		//************************************
@@ -117,7 +229,7 @@ namespace Plugin
 		static inline std::vector<FuncPtr> GetPluginFuncs(const char* handle) noexcept
 		{
 			PluginManager& p = GetInstance();
-			return p.GetHandle(handle).As<FuncPtr>();
+			return p.CopyHandle(handle).As<FuncPtr>();
 		}
 
 		//************************************
@@ -125,7 +237,7 @@ namespace Plugin
 		//************************************
 		inline std::vector<void*> GetPluginFuncs(const char* handle) noexcept
 		{
-			return GetHandle(handle).Pointers();
+			return CopyHandle(handle).Pointers();
 		}
 
 		//************************************
@@ -140,11 +252,228 @@ namespace Plugin
 		template<typename T>
 		inline T ExecutePlugins(const char* handle, T data)
 		{
-			std::vector<T(*)(T)> _f = GetPluginFuncs<T(*)(T)>(handle);
+			// the generation matches this copy of the handle, so a
+			// result from an outdated function list is never stored
+			uint64_t generation = 0;
+			PluginHandle h = CopyHandle(handle, generation);
+			std::vector<T(*)(T)> _f = h.As<T(*)(T)>();
+
+			// reuse the last result if every function is pure
+			std::string key;
+			bool memo = !_f.empty() && MakeMemoKey(h.GetPurity(), key, data);
+			if (memo && m_memo.Find(handle, key, data))
+				return data;
+
 			for (auto f : _f)
 				data = f(data);
+
+			if (memo)
+				m_memo.Store(handle, key, data, generation);
 			return data;
 		}
+
+		//************************************
+		// Call every plugin function for a
+		// specific handle with the same
+		// arguments and collect the results
+		//************************************
+		template<typename R, typename... Args>
+		inline std::vector<R> CollectPlugins(const char* handle, Args... args)
+		{
+			uint64_t generation = 0;
+			PluginHandle h = CopyHandle(handle, generation);
+			std::vector<R(*)(Args...)> _f = h.As<R(*)(Args...)>();
+
+			std::vector<R> results;
+			std::string key;
+			bool memo = !_f.empty() && MakeMemoKey(h.GetPurity(), key, args...);
+			if (memo && m_memo.Find(handle, key, results))
+				return results;
+
+			for (auto f : _f)
+				results.push_back(f(args...));
+
+			if (memo)
+				m_memo.Store(handle, key, results, generation);
+			return results;
+		}
+
+		//************************************
+		// Hit rate of the result cache for
+		// pure and constant handlers
+		//************************************
+		inline MemoStats GetMemoStats() noexcept { return m_memo.Stats(); }
+
+		//************************************
+		// Allocate from the arena for scope,
+		// call and frame arenas belong to the
+		// calling thread, plugin is only used
+		// to find the arena for
+		// AllocScope::Plugin
+		//************************************
+		inline void* Allocate(size_t size, size_t align, AllocScope scope, void* plugin = nullptr) noexcept
+		{
+			if (scope != AllocScope::Plugin)
+				return ThreadArena(scope).Allocate(size, align);
+			std::lock_guard<std::mutex> lock(m_allocLock);
+			return AllocatorFor(plugin).arena.Allocate(size, align);
+		}
+
+		//************************************
+		// Allocate a single object from the
+		// plugin's pool for its size class,
+		// objects too large for any pool are
+		// allocated on their own
+		//************************************
+		inline void* AllocateObject(size_t size, void* plugin = nullptr) noexcept
+		{
+			std::lock_guard<std::mutex> lock(m_allocLock);
+			PluginAllocator& a = AllocatorFor(plugin);
+			if (size > MAX_POOL_OBJECT)
+			{
+				char* object = new char[size];
+				a.large[object].reset(object);
+				return object;
+			}
+			size_t sizeClass = SizeClass(size);
+			std::unique_ptr<Pool>& pool = a.pools[sizeClass];
+			if (pool == nullptr)
+				pool.reset(new Pool(sizeClass, ChunkCount(sizeClass)));
+			return pool->Allocate();
+		}
+
+		//************************************
+		// Return an object to its pool, or
+		// to the system if it had no pool
+		//************************************
+		inline void FreeObject(void* object, size_t size, void* plugin = nullptr) noexcept
+		{
+			if (object == nullptr)
+				return;
+			std::lock_guard<std::mutex> lock(m_allocLock);
+			PluginAllocator& a = AllocatorFor(plugin);
+			if (size > MAX_POOL_OBJECT)
+			{
+				size_t erased = a.large.erase(object);
+				assert(erased == 1);
+				(void)erased;
+				return;
+			}
+			auto pool = a.pools.find(SizeClass(size));
+			assert(pool != a.pools.end());
+			pool->second->Free(object);
+		}
+
+		//************************************
+		// Free everything the calling thread
+		// allocated for a call or a frame in
+		// one go
+		//************************************
+		inline void ResetArena(AllocScope scope) noexcept
+		{
+			assert(scope != AllocScope::Plugin);
+			ThreadArena(scope).Reset();
+		}
+
+		//************************************
+		// Allocation counters for the calling
+		// thread's call or frame arena
+		//************************************
+		inline AllocatorStats GetArenaStats(AllocScope scope) noexcept
+		{
+			assert(scope != AllocScope::Plugin);
+			return ThreadArena(scope).Stats();
+		}
+
+		//************************************
+		// Set the renderer plugins mark
+		// dirty regions on, or nullptr,
+		// returns the one it replaces. The
+		// host keeps it set for as long as
+		// the renderer lives; once this
+		// returns no plugin is still using
+		// the old one, so it may be freed
+		//************************************
+		inline Renderer* SetRenderer(Renderer* renderer) noexcept
+		{
+			std::lock_guard<std::mutex> lock(m_rendererLock);
+			Renderer* previous = m_renderer;
+			m_renderer = renderer;
+			return previous;
+		}
+
+		//************************************
+		// Forward a dirty region to the
+		// current renderer, if any
+		//************************************
+		inline void MarkDirty(int x, int y, int w, int h) noexcept
+		{
+			std::lock_guard<std::mutex> lock(m_rendererLock);
+			if (m_renderer != nullptr)
+				m_renderer->MarkDirty(x, y, w, h);
+		}
+
+		//************************************
+		// Publish a batch of events to a
+		// topic, returns how many were
+		// accepted before it filled up
+		//************************************
+		inline size_t Publish(const char* topic, const void* events, size_t size, size_t count) noexcept
+		{
+			return m_events.Publish(topic, events, size, count);
+		}
+
+		//************************************
+		// Publish to a topic from OpenTopic
+		//************************************
+		inline size_t Publish(void* topic, const void* events, size_t size, size_t count) noexcept
+		{
+			return m_events.Publish(static_cast<EventTopic*>(topic), events, size, count);
+		}
+
+		//************************************
+		// Look a topic up once so it can be
+		// published to without the name
+		//************************************
+		inline void* OpenTopic(const char* topic) noexcept
+		{
+			return m_events.Open(topic);
+		}
+
+		//************************************
+		// Subscribe to a topic
+		//************************************
+		inline void Subscribe(const char* topic, void* func) noexcept
+		{
+			m_events.Subscribe(topic, func);
+		}
+
+		//************************************
+		// Unsubscribe from a topic
+		//************************************
+		inline void Unsubscribe(const char* topic, void* func) noexcept
+		{
+			m_events.Unsubscribe(topic, func);
+		}
+
+		//************************************
+		// Queue depth and drop counters
+		// for a topic
+		//************************************
+		inline TopicStats GetTopicStats(const char* topic) noexcept
+		{
+			return m_events.Stats(topic);
+		}
+
+		//************************************
+		// Counters for a topic from
+		// OpenTopic
+		//************************************
+		inline TopicStats GetTopicStats(void* topic) noexcept
+		{
+			assert(topic != nullptr);
+			return static_cast<EventTopic*>(topic)->Stats();
+		}
 	private:
 		//************************************
 		// Default constructor is acceptable
@@ -159,11 +488,175 @@ namespace Plugin
 		inline PluginManager& operator=(const PluginManager&) = delete;
 		inline PluginManager& operator=(PluginManager&&) = delete;
 
+		//************************************
+		// Copy a handle along with its
+		// cache generation, read together
+		// under the lock that Register and
+		// Unregister bump it under
+		//************************************
+		inline PluginHandle CopyHandle(const char* handle, uint64_t& generation) noexcept
+		{
+			std::lock_guard<std::mutex> lock(m_handleLock);
+			generation = m_memo.Generation(handle);
+			auto h = m_handles.find(handle);
+			return h == m_handles.end() ? PluginHandle() : h->second;
+		}
+
+		//************************************
+		// Load and check the DLL at filename
+		// without running its entry point
+		//************************************
+		void* OpenPlugin(const char* filename) noexcept;
+
+		//************************************
+		// Run a loaded plugin's entry point
+		//************************************
+		void InitPlugin(void* plugin) noexcept;
+
+		//************************************
+		// A registration held back while a
+		// wave of plugins initializes, the
+		// name is copied since it may not
+		// outlive the call
+		//************************************
+		struct StagedOp
+		{
+			std::string handle;
+			void* function;
+			Purity purity;
+			bool attach;
+		};
+
+		//************************************
+		// Where the calling thread's
+		// registrations are being staged,
+		// null when they apply right away
+		//************************************
+		static inline std::vector<StagedOp>*& Staging() noexcept
+		{
+			static thread_local std::vector<StagedOp>* staging = nullptr;
+			return staging;
+		}
+
+		//************************************
+		// Hold back a registration if this
+		// thread is staging, returns false
+		// if it should be applied now
+		//************************************
+		static inline bool Stage(const char* handle, void* func, Purity purity, bool attach)
+		{
+			std::vector<StagedOp>* staging = Staging();
+			if (staging == nullptr)
+				return false;
+			assert(handle != nullptr);
+			staging->push_back({ handle, func, purity, attach });
+			return true;
+		}
+
+		// pools up to this size are 16 bytes apart, larger
+		// ones are powers of two
+		static const size_t SMALL_POOL_OBJECT = 256;
+		// objects larger than this skip the pools
+		static const size_t MAX_POOL_OBJECT = 64 * 1024;
+		// the bytes in each chunk of a power of two pool
+		static const size_t LARGE_POOL_CHUNK = 64 * 1024;
+
+		//************************************
+		// Everything a single plugin has
+		// allocated from the host
+		//************************************
+		struct PluginAllocator
+		{
+			Arena arena;
+			std::unordered_map<size_t, std::unique_ptr<Pool>> pools;
+			// objects too large for a pool
+			std::unordered_map<void*, std::unique_ptr<char[]>> large;
+		};
+
+		//************************************
+		// Round a size up to its pool
+		//************************************
+		static inline size_t SizeClass(size_t size) noexcept
+		{
+			if (size <= SMALL_POOL_OBJECT)
+				return (size + 15) & ~size_t(15);
+			size_t sizeClass = SMALL_POOL_OBJECT;
+			while (sizeClass < size)
+				sizeClass <<= 1;
+			return sizeClass;
+		}
+
+		//************************************
+		// Objects per chunk for a pool, so a
+		// big size class does not take a
+		// huge chunk for its first object
+		//************************************
+		static inline size_t ChunkCount(size_t sizeClass) noexcept
+		{
+			if (sizeClass <= SMALL_POOL_OBJECT)
+				return DEFAULT_POOL_CHUNK;
+			return sizeClass < LARGE_POOL_CHUNK ? LARGE_POOL_CHUNK / sizeClass : 1;
+		}
+
+		//************************************
+		// Plugin allocator getter, must be
+		// called with m_allocLock held
+		//************************************
+		inline PluginAllocator& AllocatorFor(void* plugin)
+		{
+			std::unique_ptr<PluginAllocator>& a = m_pluginAllocators[plugin];
+			if (a == nullptr)
+				a.reset(new PluginAllocator());
+			return *a;
+		}
+
+		//************************************
+		// Build the cache key for a call,
+		// returns false if the results of
+		// this call must not be cached
+		//************************************
+		template<typename... Args>
+		static inline bool MakeMemoKey(Purity purity, std::string& key, const Args&... args) noexcept
+		{
+			if (purity == Purity::Impure) return false;
+			// constant results do not depend on the arguments at all
+			if (purity == Purity::Constant) return true;
+			bool keyed = true;
+			using expand = int[];
+			(void)expand{ 0, (keyed = MemoKey<Args>::Append(key, args) && keyed, 0)... };
+			return keyed;
+		}
+
 		std::unordered_map<std::string, PluginHandle> m_handles = {};
 
+		// guards m_handles, plugins may register
+		// from several threads at once
+		std::mutex m_handleLock;
+
 		// the vector of handles to free when
 		// the plugin manager is destoryed
 		std::vector<void*> m_plugins = {};
+
+		// m_plugins grouped by the wave they were
+		// initialized in, torn down in reverse
+		std::vector<std::vector<void*>> m_waves = {};
+
+		// asynchronous topics plugins use to
+		// talk to each other
+		EventBus m_events;
+
+		// results of pure and constant handlers
+		MemoCache m_memo;
+
+		// guards the memory handed out to plugins, the
+		// call and frame arenas are per thread instead
+		std::mutex m_allocLock;
+		std::unordered_map<void*, std::unique_ptr<PluginAllocator>> m_pluginAllocators = {};
+
+		// the renderer dirty regions go to, the lock is held
+		// while forwarding so it cannot be swapped out mid call
+		std::mutex m_rendererLock;
+		Renderer* m_renderer = nullptr;
 	};
 
 	// alias plugin manager for convenience
@@ -0,0 +1,216 @@
+//**************************************
+// renderer.h
+//
+// Holds the declaration for a retained
+// mode terminal renderer. It keeps the
+// last frame it presented, compares the
+// next one against it a row at a time
+// and only writes the runs of cells
+// that changed, positioned with ANSI
+// cursor escapes, in a single write
+//
+// Plugins that scribble on the terminal
+// themselves can mark regions dirty to
+// have them repainted on the next frame
+//
+// Author: Nathan Ikola
+// nathan.ikola@gmail.com
+//**************************************
+#pragma once
+
+#include <assert.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Plugin
+{
+	// unchanged cells shorter than this are rewritten rather
+	// than skipped, a cursor escape costs about as much
+	const int MIN_SKIP_RUN = 8;
+
+	//**********************************
+	// Cost of the last frame
+	//**********************************
+	struct FrameStats
+	{
+		// bytes handed to the terminal
+		size_t bytes = 0;
+		// cells rewritten
+		size_t cells = 0;
+		// rows that compared equal and were not written
+		size_t cleanRows = 0;
+		// time spent diffing and writing
+		double ms = 0.0;
+	};
+
+	class Renderer final
+	{
+	public:
+		//******************************
+		// Ctor takes the stream to
+		// write frames to
+		//******************************
+		inline Renderer(std::ostream& out = std::cout) noexcept : m_stream(out) {}
+
+		Renderer(const Renderer&) = delete;
+		Renderer& operator=(const Renderer&) = delete;
+
+		//******************************
+		// Change the frame size, the
+		// next frame is drawn in full
+		//******************************
+		inline void Resize(int w, int h)
+		{
+			assert(w >= 0 && h >= 0);
+			std::lock_guard<std::mutex> lock(m_dirtyLock);
+			m_width = w;
+			m_height = h;
+			m_back.assign(static_cast<size_t>(w) * h, ' ');
+			// nothing printable matches a zero, so every cell differs
+			m_front.assign(static_cast<size_t>(w) * h, '\0');
+			m_dirty.assign(h, { w, 0 });
+		}
+
+		//******************************
+		// Row y of the frame being
+		// built, w cells long
+		//******************************
+		inline char* Row(int y) noexcept
+		{
+			assert(y >= 0 && y < m_height);
+			return &m_back[static_cast<size_t>(y) * m_width];
+		}
+
+		//******************************
+		// Force a region to be written
+		// on the next frame even if it
+		// has not changed. Safe to call
+		// from any thread
+		//******************************
+		inline void MarkDirty(int x, int y, int w, int h) noexcept
+		{
+			std::lock_guard<std::mutex> lock(m_dirtyLock);
+			int x0 = x < 0 ? 0 : x;
+			int x1 = x + w > m_width ? m_width : x + w;
+			for (int r{ y < 0 ? 0 : y }; r < y + h && r < m_height; ++r)
+			{
+				if (x0 < m_dirty[r].first) m_dirty[r].first = x0;
+				if (x1 > m_dirty[r].second) m_dirty[r].second = x1;
+			}
+		}
+
+		//******************************
+		// Write whatever changed since
+		// the last frame
+		//******************************
+		void Present()
+		{
+			auto start = std::chrono::steady_clock::now();
+			m_stats = FrameStats();
+			m_out.clear();
+
+			std::vector<std::pair<int, int>> dirty;
+			{
+				std::lock_guard<std::mutex> lock(m_dirtyLock);
+				dirty.swap(m_dirty);
+				m_dirty.assign(m_height, { m_width, 0 });
+			}
+
+			for (int y{ 0 }; y < m_height; ++y)
+			{
+				char* back = Row(y);
+				char* front = &m_front[static_cast<size_t>(y) * m_width];
+				int forcedFrom = dirty[y].first;
+				int forcedTo = dirty[y].second;
+
+				// most rows of an animated map do not change at all
+				if (forcedFrom >= forcedTo && std::memcmp(back, front, m_width) == 0)
+				{
+					++m_stats.cleanRows;
+					continue;
+				}
+
+				int x = 0;
+				while (x < m_width)
+				{
+					// skip to the next cell that has to be written
+					while (x < m_width && back[x] == front[x] && (x < forcedFrom || x >= forcedTo))
+						++x;
+					if (x == m_width)
+						break;
+
+					// extend the run until a long enough stretch is clean
+					int end = x + 1, clean = 0;
+					while (end < m_width && clean < MIN_SKIP_RUN)
+					{
+						if (back[end] == front[end] && (end < forcedFrom || end >= forcedTo)) ++clean;
+						else clean = 0;
+						++end;
+					}
+					end -= clean;
+
+					MoveCursor(x, y);
+					m_out.append(back + x, end - x);
+					std::memcpy(front + x, back + x, end - x);
+					m_stats.cells += end - x;
+					x = end;
+				}
+			}
+
+			// leave the cursor underneath the frame
+			if (!m_out.empty())
+				MoveCursor(0, m_height);
+
+			m_stream.write(m_out.data(), m_out.size());
+			m_stream.flush();
+			m_stats.bytes = m_out.size();
+			m_stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		//******************************
+		// Frame dimensions
+		//******************************
+		inline int Width() const noexcept { return m_width; }
+		inline int Height() const noexcept { return m_height; }
+
+		//******************************
+		// Cost of the last Present
+		//******************************
+		inline const FrameStats& Stats() const noexcept { return m_stats; }
+	private:
+		//******************************
+		// Append an escape moving the
+		// cursor to the 0 based cell
+		//******************************
+		inline void MoveCursor(int x, int y)
+		{
+			m_out += "\x1b[";
+			m_out += std::to_string(y + 1);
+			m_out += ';';
+			m_out += std::to_string(x + 1);
+			m_out += 'H';
+		}
+
+		std::ostream& m_stream;
+		// only changed under m_dirtyLock, MarkDirty reads them
+		int m_width = 0;
+		int m_height = 0;
+
+		// the frame being built and the frame on screen
+		std::vector<char> m_back = {};
+		std::vector<char> m_front = {};
+
+		// per row [from, to) columns to repaint regardless
+		std::mutex m_dirtyLock;
+		std::vector<std::pair<int, int>> m_dirty = {};
+
+		// reused between frames so a frame is one allocation at most
+		std::string m_out;
+		FrameStats m_stats;
+	};
+}
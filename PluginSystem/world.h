@@ -0,0 +1,376 @@
+//**************************************
+// world.h
+//
+// Holds the declaration for an endless
+// map made of fixed size tiles. Tiles
+// are generated from (seed, tile x,
+// tile y) alone, so they can be cached
+// and shared between threads, and a
+// viewport moving over the world mostly
+// reuses tiles it has already made
+//
+// The cache is bounded by memory and
+// evicts the least recently used tile.
+// A background thread generates the
+// tiles just ahead of the viewport in
+// the direction it is moving
+//
+// Author: Nathan Ikola
+// nathan.ikola@gmail.com
+//**************************************
+#pragma once
+
+#include <algorithm>
+#include <assert.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "map.h"
+#include "renderer.h"
+
+namespace Plugin
+{
+	// the width and height of a tile in cells
+	const int DEFAULT_TILE_SIZE = 32;
+	// the most memory the tile cache may hold
+	const size_t DEFAULT_TILE_BUDGET = 4 * 1024 * 1024;
+	// the most tiles waiting to be prefetched
+	const size_t MAX_PREFETCH_QUEUE = 64;
+
+	//**********************************
+	// Address of a tile in the world
+	//**********************************
+	struct TileKey
+	{
+		int seed;
+		// tile coordinates, wider than a cell coordinate so the
+		// tiles past the edge of an int sized world still exist
+		int64_t x;
+		int64_t y;
+
+		inline bool operator==(const TileKey& rhs) const noexcept
+		{
+			return seed == rhs.seed && x == rhs.x && y == rhs.y;
+		}
+	};
+
+	struct TileKeyHash
+	{
+		inline size_t operator()(const TileKey& k) const noexcept
+		{
+			uint64_t h = static_cast<uint32_t>(k.seed);
+			h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(k.x);
+			h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(k.y);
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+	};
+
+	//**********************************
+	// A square block of cells, stored
+	// row after row
+	//**********************************
+	using Tile = std::vector<char>;
+
+	//**********************************
+	// Tile cache counters
+	//**********************************
+	struct TileCacheStats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+		uint64_t prefetched = 0;
+		size_t tiles = 0;
+		size_t bytes = 0;
+		size_t budget = 0;
+
+		// fraction of tile lookups served from the cache
+		inline double HitRate() const noexcept
+		{
+			uint64_t total = hits + misses;
+			return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+		}
+	};
+
+	class World final
+	{
+	public:
+		//******************************
+		// Ctor takes the map whose
+		// symbols the world is made of,
+		// which must outlive it
+		//******************************
+		inline World(const Map& map, int tileSize = DEFAULT_TILE_SIZE, size_t budget = DEFAULT_TILE_BUDGET)
+			: m_map(map), m_tileSize(tileSize), m_budget(budget)
+		{
+			assert(tileSize > 0);
+			m_prefetcher = std::thread(&World::Prefetch, this);
+		}
+
+		//******************************
+		// Dtor stops the prefetcher
+		//******************************
+		inline ~World() noexcept
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_stop = true;
+			}
+			m_wake.notify_one();
+			if (m_prefetcher.joinable())
+				m_prefetcher.join();
+		}
+
+		World(const World&) = delete;
+		World& operator=(const World&) = delete;
+
+		//******************************
+		// Get a tile, generating it if
+		// it is not cached. Safe to
+		// call from any thread
+		//******************************
+		std::shared_ptr<const Tile> GetTile(int seed, int64_t tx, int64_t ty)
+		{
+			TileKey key = { seed, tx, ty };
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				auto t = m_tiles.find(key);
+				if (t != m_tiles.end())
+				{
+					m_lru.splice(m_lru.begin(), m_lru, t->second.lru);
+					++m_stats.hits;
+					return t->second.tile;
+				}
+				++m_stats.misses;
+			}
+			// generate outside the lock so other threads are not held up
+			std::shared_ptr<const Tile> tile = Generate(key);
+			return Insert(key, tile);
+		}
+
+		//******************************
+		// Draw the part of the world
+		// at (x, y) that fits in the
+		// renderer, then prefetch the
+		// tiles the viewport is moving
+		// towards
+		//******************************
+		void Draw(Renderer& renderer, int x, int y, int seed)
+		{
+			// let plugins adjust the seed, this is cached when they are pure
+			seed = PMgr::GetInstance().ExecutePlugins("seedGeneration", seed);
+
+			// the far edges of the viewport can fall outside an int
+			const int w = renderer.Width(), h = renderer.Height();
+			const int64_t right = static_cast<int64_t>(x) + w, bottom = static_cast<int64_t>(y) + h;
+			for (int64_t ty{ FloorDiv(y) }; ty <= FloorDiv(bottom - 1); ++ty)
+				for (int64_t tx{ FloorDiv(x) }; tx <= FloorDiv(right - 1); ++tx)
+				{
+					std::shared_ptr<const Tile> tile = GetTile(seed, tx, ty);
+
+					// the part of this tile that overlaps the viewport
+					const int64_t left = tx * m_tileSize, top = ty * m_tileSize;
+					int64_t x0 = std::max<int64_t>(left, x), x1 = std::min<int64_t>(left + m_tileSize, right);
+					int64_t y0 = std::max<int64_t>(top, y), y1 = std::min<int64_t>(top + m_tileSize, bottom);
+					for (int64_t wy{ y0 }; wy < y1; ++wy)
+					{
+						const char* src = &(*tile)[static_cast<size_t>((wy - top) * m_tileSize + (x0 - left))];
+						std::memcpy(renderer.Row(static_cast<int>(wy - y)) + (x0 - x), src, static_cast<size_t>(x1 - x0));
+					}
+				}
+			renderer.Present();
+
+			QueueAhead(x, y, w, h, seed);
+			m_lastX = x;
+			m_lastY = y;
+			m_hasLast = true;
+		}
+
+		//******************************
+		// Snapshot of the counters
+		//******************************
+		inline TileCacheStats Stats()
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			TileCacheStats s = m_stats;
+			s.tiles = m_tiles.size();
+			s.bytes = m_bytes;
+			s.budget = m_budget;
+			return s;
+		}
+
+		//******************************
+		// Tile size in cells
+		//******************************
+		inline int TileSize() const noexcept { return m_tileSize; }
+	private:
+		struct Entry
+		{
+			std::shared_ptr<const Tile> tile;
+			std::list<TileKey>::iterator lru;
+		};
+
+		//******************************
+		// Tile coordinate of a cell,
+		// rounding toward -infinity
+		//******************************
+		inline int64_t FloorDiv(int64_t v) const noexcept
+		{
+			// division truncates toward zero, so step down for a negative remainder
+			return v / m_tileSize - (v % m_tileSize < 0);
+		}
+
+		//******************************
+		// Build a tile from the map's
+		// cells at its world position,
+		// so neighbouring tiles line up
+		//******************************
+		std::shared_ptr<const Tile> Generate(const TileKey& key) const
+		{
+			std::shared_ptr<Tile> tile = std::make_shared<Tile>(static_cast<size_t>(m_tileSize) * m_tileSize);
+			// world positions of far away tiles do not fit in an int
+			const int64_t left = key.x * m_tileSize;
+			const int64_t top = key.y * m_tileSize;
+			for (int cy{ 0 }; cy < m_tileSize; ++cy)
+				for (int cx{ 0 }; cx < m_tileSize; ++cx)
+					(*tile)[cy * m_tileSize + cx] = m_map.Cell(key.seed, left + cx, top + cy);
+			return tile;
+		}
+
+		//******************************
+		// Add a freshly generated tile,
+		// keeping the one another thread
+		// made first if there is one
+		//******************************
+		std::shared_ptr<const Tile> Insert(const TileKey& key, const std::shared_ptr<const Tile>& tile)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			auto t = m_tiles.find(key);
+			if (t != m_tiles.end())
+				return t->second.tile;
+
+			m_lru.push_front(key);
+			m_tiles[key] = { tile, m_lru.begin() };
+			m_bytes += TileBytes();
+
+			// keep at least the tile we just made
+			while (m_bytes > m_budget && m_lru.size() > 1)
+			{
+				m_tiles.erase(m_lru.back());
+				m_lru.pop_back();
+				m_bytes -= TileBytes();
+				++m_stats.evictions;
+			}
+			return tile;
+		}
+
+		//******************************
+		// Memory one cached tile takes
+		//******************************
+		inline size_t TileBytes() const noexcept
+		{
+			return static_cast<size_t>(m_tileSize) * m_tileSize + sizeof(Tile) + sizeof(Entry) + sizeof(TileKey);
+		}
+
+		//******************************
+		// Queue the row or column of
+		// tiles just past the edge the
+		// viewport is moving towards
+		//******************************
+		void QueueAhead(int x, int y, int w, int h, int seed)
+		{
+			if (!m_hasLast || (x == m_lastX && y == m_lastY))
+				return;
+			int dx = (x > m_lastX) - (x < m_lastX);
+			int dy = (y > m_lastY) - (y < m_lastY);
+			// tiles queued for the old direction are no longer ahead
+			bool turned = dx != m_lastDx || dy != m_lastDy;
+			m_lastDx = dx;
+			m_lastDy = dy;
+
+			std::vector<TileKey> ahead;
+			int64_t left = FloorDiv(x), right = FloorDiv(static_cast<int64_t>(x) + w - 1);
+			int64_t top = FloorDiv(y), bottom = FloorDiv(static_cast<int64_t>(y) + h - 1);
+			if (dx != 0)
+				for (int64_t ty{ top - 1 }; ty <= bottom + 1; ++ty)
+					ahead.push_back({ seed, dx > 0 ? right + 1 : left - 1, ty });
+			if (dy != 0)
+				for (int64_t tx{ left - 1 }; tx <= right + 1; ++tx)
+					ahead.push_back({ seed, tx, dy > 0 ? bottom + 1 : top - 1 });
+
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				if (turned)
+					m_queue.clear();
+				for (const TileKey& k : ahead)
+				{
+					if (m_tiles.find(k) != m_tiles.end() || std::find(m_queue.begin(), m_queue.end(), k) != m_queue.end())
+						continue;
+					// the oldest tiles are the furthest behind the viewport
+					if (m_queue.size() == MAX_PREFETCH_QUEUE)
+						m_queue.pop_front();
+					m_queue.push_back(k);
+				}
+			}
+			m_wake.notify_one();
+		}
+
+		//******************************
+		// Prefetch thread body
+		//******************************
+		void Prefetch()
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			for (;;)
+			{
+				m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+				if (m_stop)
+					return;
+				TileKey key = m_queue.front();
+				m_queue.pop_front();
+				if (m_tiles.find(key) != m_tiles.end())
+					continue;
+
+				lock.unlock();
+				std::shared_ptr<const Tile> tile = Generate(key);
+				// Insert hands back another thread's tile if it got there first
+				bool inserted = Insert(key, tile) == tile;
+				lock.lock();
+				if (inserted)
+					++m_stats.prefetched;
+			}
+		}
+
+		const Map& m_map;
+		const int m_tileSize;
+		const size_t m_budget;
+
+		// guards everything below
+		std::mutex m_lock;
+		std::unordered_map<TileKey, Entry, TileKeyHash> m_tiles = {};
+		// most recently used at the front
+		std::list<TileKey> m_lru = {};
+		size_t m_bytes = 0;
+		TileCacheStats m_stats;
+
+		std::deque<TileKey> m_queue = {};
+		std::condition_variable m_wake;
+		bool m_stop = false;
+		std::thread m_prefetcher;
+
+		// where the viewport was last drawn, only touched by Draw
+		int m_lastX = 0;
+		int m_lastY = 0;
+		int m_lastDx = 0;
+		int m_lastDy = 0;
+		bool m_hasLast = false;
+	};
+}